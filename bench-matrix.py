@@ -0,0 +1,117 @@
+"""
+Benchmark matrix for the C++ indexer.
+
+Builds cpp-indexer.cpp once per build variant, generates each tree shape with
+generate-bench-data.py (reused when a tree with the same parameters already
+exists), then runs `bench --json` for every shape x variant x worker count.
+Every result is appended to a JSONL file, tagged with the shape, variant and
+seed, and a summary table is printed at the end.
+
+Example:
+    python3 bench-matrix.py --shapes tiny,mixed --workers 1,2,4,8 --scale 0.01
+    python3 bench-matrix.py --shapes huge --variants O2 -- --hash blake3
+
+"""
+
+from __future__ import annotations
+
+import argparse
+import json
+import subprocess
+import sys
+from pathlib import Path
+from typing import Dict, Any, List
+
+REPO = Path(__file__).resolve().parent
+SOURCE = REPO / "c++" / "cpp-indexer.cpp"
+GENERATOR = REPO / "generate-bench-data.py"
+
+#compiler flags per build variant; O0 and O2 are the README's variants A and B
+VARIANTS = {
+    "O0": ["-O0"],
+    "O2": ["-O2"],
+    "O3-native": ["-O3", "-march=native"],
+}
+
+
+def build(variant: str, cxx: str, build_dir: Path) -> Path:
+    """the indexer binary for `variant`, rebuilt when the source is newer"""
+    binary = build_dir / f"cpp_indexer_{variant}"
+    if binary.exists() and binary.stat().st_mtime >= SOURCE.stat().st_mtime:
+        return binary
+    build_dir.mkdir(parents=True, exist_ok=True)
+    cmd = [cxx, "-std=c++17", *VARIANTS[variant], str(SOURCE), "-o", str(binary)]
+    print("building", " ".join(cmd), file=sys.stderr)
+    subprocess.run(cmd, check=True)
+    return binary
+
+
+def dataset(shape: str, args: argparse.Namespace) -> Path:
+    """the tree for `shape`, generated unless an identical one already exists"""
+    tag = f"{shape}-s{args.seed}-x{args.scale:g}-d{args.dupes:g}"
+    root = args.data_dir / tag
+    manifest = args.data_dir / (tag + ".json")
+    if manifest.exists():
+        return root
+    cmd = [sys.executable, str(GENERATOR), "--shape", shape, "--out", str(root),
+           "--scale", str(args.scale), "--seed", str(args.seed), "--dupes", str(args.dupes)]
+    print("generating", " ".join(cmd), file=sys.stderr)
+    subprocess.run(cmd, check=True)
+    return root
+
+
+def run_bench(binary: Path, root: Path, workers: int, args: argparse.Namespace) -> Dict[str, Any]:
+    cmd = [str(binary), "bench", str(root), str(workers), "--runs", str(args.runs),
+           "--cache", args.cache, "--json", *args.extra]
+    out = subprocess.run(cmd, check=True, capture_output=True, text=True).stdout
+    return json.loads(out)
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description="Run the C++ indexer benchmark matrix")
+    parser.add_argument("--shapes", default="tiny,deep,wide,huge,mixed")
+    parser.add_argument("--variants", default="O0,O2",
+                        help="comma-separated build variants: " + ", ".join(VARIANTS))
+    parser.add_argument("--workers", default="1,2,4,8", help="comma-separated worker counts")
+    parser.add_argument("--runs", type=int, default=3, help="timed runs per cell")
+    parser.add_argument("--cache", choices=["warm", "cold"], default="warm")
+    parser.add_argument("--scale", type=float, default=1.0,
+                        help="dataset size relative to each shape's default")
+    parser.add_argument("--dupes", type=float, default=0.0)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--cxx", default="g++")
+    parser.add_argument("--build-dir", type=Path, default=REPO / "bench_build")
+    parser.add_argument("--data-dir", type=Path, default=REPO / "bench_data")
+    parser.add_argument("--out", type=Path, default=Path("bench-results.jsonl"))
+    parser.add_argument("extra", nargs="*", help="options passed to every bench run, after --")
+    args = parser.parse_args()
+
+    variants = args.variants.split(",")
+    for v in variants:
+        if v not in VARIANTS:
+            parser.error(f"unknown variant {v}")
+    binaries = {v: build(v, args.cxx, args.build_dir) for v in variants}
+    worker_counts = [int(w) for w in args.workers.split(",")]
+
+    rows: List[Dict[str, Any]] = []
+    with args.out.open("a", encoding="utf-8") as out:
+        for shape in args.shapes.split(","):
+            root = dataset(shape, args)
+            for variant in variants:
+                for workers in worker_counts:
+                    result = run_bench(binaries[variant], root, workers, args)
+                    result.update({"shape": shape, "variant": variant, "seed": args.seed,
+                                   "scale": args.scale, "extra": args.extra})
+                    out.write(json.dumps(result) + "\n")
+                    out.flush()
+                    rows.append(result)
+                    m = result["median"]
+                    print(f"{shape:6} {variant:10} {workers:3}  {m['wall_s']:8.3f} s"
+                          f"  {m['files_per_s']:12.1f} files/s  {m['mb_per_s']:9.1f} MB/s"
+                          f"  p99 {m['latency_p99_s'] * 1e3:8.3f} ms", flush=True)
+
+    print(f"{len(rows)} results appended to {args.out}")
+
+
+if __name__ == "__main__":
+    main()
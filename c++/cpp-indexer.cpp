@@ -1,45 +1,198 @@
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
 #include <vector>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <queue>
+#include <deque>
 #include <unordered_map>
+#include <unordered_set>
+#include <functional>
+#include <memory>
 #include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <csetjmp>
+#include <csignal>
+#include <algorithm>
+#include <string_view>
+#include <charconv>
+#include <fnmatch.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define INDEXER_URING 1
+#endif
+
+#if defined(__linux__) && __has_include(<sys/inotify.h>)
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <map>
+#include <shared_mutex>
+#define INDEXER_SERVE 1
+#endif
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/statfs.h>
+#include <sys/sysmacros.h>
+#endif
 
 namespace fs = std::filesystem;
 
 // SHA-256 implementation for hashing (public-domain: can be used freely)
 #include <array>
 #include <vector>
-#include <sstream>
-#include <iomanip>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define SHA256_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#define SHA256_ARM 1
+#endif
 
 class SHA256 {
 public:
-    static std::string hashFile(const std::filesystem::path& path) {
-        std::ifstream file(path, std::ios::binary);
-        if (!file) return "";
+    //raw digest, hex-encoded with toHex only where it is printed or stored as text
+    using Digest = std::array<uint8_t, 32>;
+
+    //streaming interface: feed any number of byte ranges, then finalize once
+    //complete blocks are transformed straight from the caller's memory; only a
+    //partial block (under 64 bytes) is ever copied into the object
+    void update(const void* data, size_t len) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        total += len;
+
+        if (tailLen > 0) {
+            const size_t take = std::min(len, sizeof(tail) - tailLen);
+            std::memcpy(tail + tailLen, p, take);
+            tailLen += take;
+            p += take;
+            len -= take;
+            if (tailLen < sizeof(tail)) return;
+            dispatch().fn(h.data(), tail, 1);
+            tailLen = 0;
+        }
+
+        if (len >= 64) {
+            dispatch().fn(h.data(), p, len / 64);
+            p += len & ~size_t(63);
+            len &= 63;
+        }
+        std::memcpy(tail, p, len);
+        tailLen = len;
+    }
+
+    Digest finalize() {
+        uint8_t last[128];
+        dispatch().fn(h.data(), last, padTail(tail, tailLen, total, last) / 64);
+        return digestOf(h);
+    }
 
-        SHA256 ctx;
-        char buf[8192];
-        while (file.read(buf, sizeof(buf)) || file.gcount()) {
-            ctx.update(reinterpret_cast<uint8_t*>(buf), file.gcount());
+    static std::string toHex(const Digest& d) {
+        static const char digits[] = "0123456789abcdef";
+        std::string out(d.size() * 2, '0');
+        for (size_t i = 0; i < d.size(); i++) {
+            out[i * 2] = digits[d[i] >> 4];
+            out[i * 2 + 1] = digits[d[i] & 0xf];
         }
-        return ctx.final();
+        return out;
     }
 
+    //the compression function processes `blocks` consecutive 64-byte blocks
+    using TransformFn = void (*)(uint32_t* state, const uint8_t* data, size_t blocks);
+
+    //name of the compression function picked for this CPU
+    static const char* implementation() { return dispatch().name; }
+
+    //forces the portable compression function, eg: to compare against the accelerated ones
+    static void usePortable() { dispatch() = {transformPortable, "portable"}; }
+
+    //one in-memory message for hashMany
+    struct Message {
+        const uint8_t* data;
+        size_t len;
+    };
+
+    //hashes `count` independent messages and writes one digest per message
+    //with AVX2/AVX-512 (or 4-lane SSE2/NEON) the messages run side by side, one per
+    //SIMD lane; with SHA instructions on the CPU each message is hashed on its own,
+    //since a single accelerated stream is faster than the lanes
+    static void hashMany(const Message* msgs, size_t count, Digest* digests) {
+        const MultiDispatch& mb = multiDispatch();
+        if (mb.lanes > 1 && dispatch().fn == transformPortable) {
+            for (size_t i = 0; i < count; i += mb.lanes) {
+                const size_t n = std::min(count - i, static_cast<size_t>(mb.lanes));
+                std::array<uint32, 8> states[16];
+                mb.hash(msgs + i, n, states);
+                for (size_t j = 0; j < n; ++j) digests[i + j] = digestOf(states[j]);
+            }
+            return;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            SHA256 ctx;
+            ctx.update(msgs[i].data, msgs[i].len);
+            digests[i] = ctx.finalize();
+        }
+    }
+
+    //name of the multi-buffer kernel hashMany would use for this CPU
+    static const char* multiBufferImplementation() { return multiDispatch().name; }
+
 private:
     using uint32 = uint32_t;
     using uint64 = uint64_t;
 
-    std::array<uint32, 8> h = {
-        0x6a09e667,0xbb67ae85,0x3c6ef372,0xa54ff53a,
-        0x510e527f,0x9b05688c,0x1f83d9ab,0x5be0cd19
+    static constexpr uint32 k[64] = {
+        0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,
+        0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
+        0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,
+        0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,
+        0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,
+        0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
+        0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,
+        0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967,
+        0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,
+        0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,
+        0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,
+        0xd192e819,0xd6990624,0xf40e3585,0x106aa070,
+        0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,
+        0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3,
+        0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,
+        0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
     };
 
-    std::vector<uint8_t> buffer;
-    uint64 bitlen = 0;
+    static std::array<uint32, 8> initialState() {
+        return {0x6a09e667,0xbb67ae85,0x3c6ef372,0xa54ff53a,
+                0x510e527f,0x9b05688c,0x1f83d9ab,0x5be0cd19};
+    }
+
+    std::array<uint32, 8> h = initialState();
+
+    uint8_t tail[64];
+    size_t tailLen = 0;
+    uint64 total = 0;
 
     static uint32 rotr(uint32 x, uint32 n) {
         return (x >> n) | (x << (32 - n));
@@ -69,43 +222,218 @@ private:
         return rotr(x, 6) ^ rotr(x, 11) ^ rotr(x, 25);
     }
 
-    void transform(const uint8_t* chunk) {
-        static const uint32 k[64] = {
-            0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,
-            0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
-            0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,
-            0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,
-            0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,
-            0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
-            0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,
-            0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967,
-            0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,
-            0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,
-            0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,
-            0xd192e819,0xd6990624,0xf40e3585,0x106aa070,
-            0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,
-            0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3,
-            0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,
-            0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
-        };
+    //portable round loop, used when the CPU has no SHA instructions
+    static void transformPortable(uint32* state, const uint8_t* chunk, size_t blocks) {
+        for (; blocks > 0; --blocks, chunk += 64) {
+            uint32 w[64];
+            for (int i = 0; i < 16; i++) {
+                w[i] = (chunk[i * 4] << 24) |
+                       (chunk[i * 4 + 1] << 16) |
+                       (chunk[i * 4 + 2] << 8) |
+                       (chunk[i * 4 + 3]);
+            }
+            for (int i = 16; i < 64; i++) {
+                w[i] = sig1(w[i - 2]) + w[i - 7] + sig0(w[i - 15]) + w[i - 16];
+            }
+
+            uint32 a = state[0], b = state[1], c = state[2], d = state[3];
+            uint32 e = state[4], f = state[5], g = state[6], hh = state[7];
 
-        uint32 w[64];
+            for (int i = 0; i < 64; i++) {
+                uint32 t1 = hh + ep1(e) + choose(e, f, g) + k[i] + w[i];
+                uint32 t2 = ep0(a) + majority(a, b, c);
+                hh = g;
+                g = f;
+                f = e;
+                e = d + t1;
+                d = c;
+                c = b;
+                b = a;
+                a = t1 + t2;
+            }
+
+            state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+            state[4] += e; state[5] += f; state[6] += g; state[7] += hh;
+        }
+    }
+
+#if defined(SHA256_X86)
+    //x86 SHA extensions: each sha256rnds2 performs two rounds, with the message
+    //schedule for the next group computed by sha256msg1/msg2 alongside
+    //the state is kept as ABEF/CDGH, the layout the instructions expect
+    __attribute__((target("sha,sse4.1")))
+    static void transformShaNi(uint32* state, const uint8_t* data, size_t blocks) {
+        const __m128i shuf = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+        __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0])), 0xB1);
+        __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4])), 0x1B);
+        __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+        state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+        for (; blocks > 0; --blocks, data += 64) {
+            const __m128i abefSave = state0;
+            const __m128i cdghSave = state1;
+            __m128i m[4];
+
+#pragma GCC unroll 16
+            for (int g = 0; g < 16; ++g) {
+                if (g < 4) {
+                    m[g] = _mm_shuffle_epi8(
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * g)), shuf);
+                }
+                __m128i msg = _mm_add_epi32(m[g & 3],
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(&k[4 * g])));
+                state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+                if (g >= 3 && g <= 14) {
+                    __m128i next = _mm_add_epi32(m[(g + 1) & 3],
+                                                 _mm_alignr_epi8(m[g & 3], m[(g - 1) & 3], 4));
+                    m[(g + 1) & 3] = _mm_sha256msg2_epu32(next, m[g & 3]);
+                }
+                msg = _mm_shuffle_epi32(msg, 0x0E);
+                state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+                if (g >= 1 && g <= 12) {
+                    m[(g - 1) & 3] = _mm_sha256msg1_epu32(m[(g - 1) & 3], m[g & 3]);
+                }
+            }
+
+            state0 = _mm_add_epi32(state0, abefSave);
+            state1 = _mm_add_epi32(state1, cdghSave);
+        }
+
+        tmp = _mm_shuffle_epi32(state0, 0x1B);
+        state1 = _mm_shuffle_epi32(state1, 0xB1);
+        state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+        state1 = _mm_alignr_epi8(state1, tmp, 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+    }
+
+    static bool cpuHasShaNi() {
+        unsigned a, b, c, d;
+        if (!__get_cpuid(1, &a, &b, &c, &d)) return false;
+        const bool ssse3 = c & (1u << 9), sse41 = c & (1u << 19);
+        if (!__get_cpuid_count(7, 0, &a, &b, &c, &d)) return false;
+        return ssse3 && sse41 && (b & (1u << 29));
+    }
+#endif
+
+#if defined(SHA256_ARM)
+#if defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO)
+#define SHA256_ARM_TARGET
+#elif defined(__clang__)
+#define SHA256_ARM_TARGET __attribute__((target("crypto")))
+#else
+#define SHA256_ARM_TARGET __attribute__((target("+crypto")))
+#endif
+    //ARMv8 Crypto Extensions: sha256h/sha256h2 perform four rounds on ABCD/EFGH,
+    //sha256su0/su1 extend the message schedule four words at a time
+    SHA256_ARM_TARGET
+    static void transformArmv8(uint32* state, const uint8_t* data, size_t blocks) {
+        uint32x4_t state0 = vld1q_u32(&state[0]);
+        uint32x4_t state1 = vld1q_u32(&state[4]);
+
+        for (; blocks > 0; --blocks, data += 64) {
+            const uint32x4_t abcdSave = state0;
+            const uint32x4_t efghSave = state1;
+            uint32x4_t m[4];
+            for (int i = 0; i < 4; ++i) {
+                m[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+            }
+
+#pragma GCC unroll 16
+            for (int g = 0; g < 16; ++g) {
+                const uint32x4_t msg = vaddq_u32(m[g & 3], vld1q_u32(&k[4 * g]));
+                if (g < 12) m[g & 3] = vsha256su0q_u32(m[g & 3], m[(g + 1) & 3]);
+                const uint32x4_t abcd = state0;
+                state0 = vsha256hq_u32(state0, state1, msg);
+                state1 = vsha256h2q_u32(state1, abcd, msg);
+                if (g < 12) m[g & 3] = vsha256su1q_u32(m[g & 3], m[(g + 2) & 3], m[(g + 3) & 3]);
+            }
+
+            state0 = vaddq_u32(state0, abcdSave);
+            state1 = vaddq_u32(state1, efghSave);
+        }
+
+        vst1q_u32(&state[0], state0);
+        vst1q_u32(&state[4], state1);
+    }
+
+    static bool cpuHasArmv8Sha2() {
+#if defined(__APPLE__)
+        return true; //every Apple arm64 core implements the SHA-2 instructions
+#elif defined(__linux__) && defined(HWCAP_SHA2)
+        return getauxval(AT_HWCAP) & HWCAP_SHA2;
+#else
+        return false;
+#endif
+    }
+#endif
+
+    //the final one or two blocks of a message: the `remLen` (< 64) bytes after the
+    //last complete block, the 0x80 terminator, zero padding and the 64-bit
+    //big-endian bit length of the whole message
+    //returns the number of bytes written to `out` (64 or 128)
+    static size_t padTail(const uint8_t* rem, size_t remLen, uint64 totalLen, uint8_t out[128]) {
+        const size_t outLen = remLen < 56 ? 64 : 128;
+        std::memcpy(out, rem, remLen);
+        out[remLen] = 0x80;
+        std::memset(out + remLen + 1, 0, outLen - remLen - 9);
+        const uint64 bits = totalLen * 8;
+        for (int i = 0; i < 8; i++) out[outLen - 1 - i] = (bits >> (i * 8)) & 0xff;
+        return outLen;
+    }
+
+    static Digest digestOf(const std::array<uint32, 8>& state) {
+        Digest d;
+        for (int i = 0; i < 8; i++) {
+            d[i * 4] = state[i] >> 24;
+            d[i * 4 + 1] = state[i] >> 16;
+            d[i * 4 + 2] = state[i] >> 8;
+            d[i * 4 + 3] = state[i];
+        }
+        return d;
+    }
+
+    //multi-buffer SHA-256: the same round function as transformPortable, written
+    //over GCC/Clang vector types so every operation runs on all lanes at once
+    //instantiated once per SIMD width; each wrapper below carries the target
+    //attribute, so the inlined kernel is compiled for that instruction set
+    typedef uint32_t u32x4 __attribute__((vector_size(16)));
+    typedef uint32_t u32x8 __attribute__((vector_size(32)));
+    typedef uint32_t u32x16 __attribute__((vector_size(64)));
+
+    //a macro rather than a helper function: a function returning a 256/512-bit
+    //vector from code built without AVX would change its ABI
+#define SHA256_VROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+    //one block per lane: blocks[l] points at the next 64 bytes of lane l
+    template <typename V, int Lanes>
+    __attribute__((always_inline))
+    static inline void transformLanes(V* state, const uint8_t* const* blocks) {
+        V w[64];
         for (int i = 0; i < 16; i++) {
-            w[i] = (chunk[i * 4] << 24) |
-                   (chunk[i * 4 + 1] << 16) |
-                   (chunk[i * 4 + 2] << 8) |
-                   (chunk[i * 4 + 3]);
+            alignas(64) uint32 words[Lanes];
+            for (int l = 0; l < Lanes; l++) {
+                const uint8_t* c = blocks[l] + i * 4;
+                words[l] = (uint32(c[0]) << 24) | (uint32(c[1]) << 16) |
+                           (uint32(c[2]) << 8) | uint32(c[3]);
+            }
+            std::memcpy(&w[i], words, sizeof(V));
         }
         for (int i = 16; i < 64; i++) {
-            w[i] = sig1(w[i - 2]) + w[i - 7] + sig0(w[i - 15]) + w[i - 16];
+            const V s0 = SHA256_VROTR(w[i - 15], 7) ^ SHA256_VROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            const V s1 = SHA256_VROTR(w[i - 2], 17) ^ SHA256_VROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = s1 + w[i - 7] + s0 + w[i - 16];
         }
 
-        uint32 a = h[0], b = h[1], c = h[2], d = h[3];
-        uint32 e = h[4], f = h[5], g = h[6], hh = h[7];
+        V a = state[0], b = state[1], c = state[2], d = state[3];
+        V e = state[4], f = state[5], g = state[6], hh = state[7];
 
         for (int i = 0; i < 64; i++) {
-            uint32 t1 = hh + ep1(e) + choose(e, f, g) + k[i] + w[i];
-            uint32 t2 = ep0(a) + majority(a, b, c);
+            const V t1 = hh + (SHA256_VROTR(e, 6) ^ SHA256_VROTR(e, 11) ^ SHA256_VROTR(e, 25)) +
+                         ((e & f) ^ (~e & g)) + k[i] + w[i];
+            const V t2 = (SHA256_VROTR(a, 2) ^ SHA256_VROTR(a, 13) ^ SHA256_VROTR(a, 22)) +
+                         ((a & b) ^ (a & c) ^ (b & c));
             hh = g;
             g = f;
             f = e;
@@ -116,188 +444,7121 @@ private:
             a = t1 + t2;
         }
 
-        h[0] += a; h[1] += b; h[2] += c; h[3] += d;
-        h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += hh;
     }
 
-    void update(const uint8_t* data, size_t len) {
-        buffer.insert(buffer.end(), data, data + len);
-        bitlen += len * 8;
+    //hashes up to Lanes messages of any lengths together
+    //lanes step through their blocks in lockstep; a lane that runs out of blocks
+    //keeps transforming a dummy block, its digest having been saved at its last block
+    template <typename V, int Lanes>
+    __attribute__((always_inline))
+    static inline void hashLanes(const Message* msgs, size_t count, std::array<uint32, 8>* out) {
+        alignas(64) uint8_t tails[Lanes][128];
+        static const uint8_t idle[64] = {};
+        size_t fullBlocks[Lanes], totalBlocks[Lanes], maxBlocks = 0;
+        for (int l = 0; l < Lanes; l++) {
+            if (static_cast<size_t>(l) < count) {
+                fullBlocks[l] = msgs[l].len / 64;
+                totalBlocks[l] = fullBlocks[l] +
+                    padTail(msgs[l].data + fullBlocks[l] * 64, msgs[l].len % 64, msgs[l].len, tails[l]) / 64;
+            }
+            else {
+                fullBlocks[l] = totalBlocks[l] = 0;
+            }
+            maxBlocks = std::max(maxBlocks, totalBlocks[l]);
+        }
+
+        V state[8];
+        const std::array<uint32, 8> init = initialState();
+        for (int j = 0; j < 8; j++) state[j] = V{} + init[j];
 
-        while (buffer.size() >= 64) {
-            transform(buffer.data());
-            buffer.erase(buffer.begin(), buffer.begin() + 64);
+        for (size_t blk = 0; blk < maxBlocks; blk++) {
+            const uint8_t* ptrs[Lanes];
+            for (int l = 0; l < Lanes; l++) {
+                if (blk < fullBlocks[l]) ptrs[l] = msgs[l].data + blk * 64;
+                else if (blk < totalBlocks[l]) ptrs[l] = tails[l] + (blk - fullBlocks[l]) * 64;
+                else ptrs[l] = idle;
+            }
+            transformLanes<V, Lanes>(state, ptrs);
+            for (int l = 0; l < Lanes; l++) {
+                if (blk + 1 == totalBlocks[l]) {
+                    for (int j = 0; j < 8; j++) out[l][j] = state[j][l];
+                }
+            }
         }
     }
 
-    std::string final() {
-        buffer.push_back(0x80);
-        while (buffer.size() % 64 != 56) buffer.push_back(0);
-        for (int i = 7; i >= 0; i--) buffer.push_back((bitlen >> (i * 8)) & 0xff);
-        transform(buffer.data());
+#undef SHA256_VROTR
 
-        std::ostringstream out;
-        for (auto x : h) out << std::hex << std::setw(8) << std::setfill('0') << x;
-        return out.str();
+    //4 lanes fit the 128-bit registers every x86-64 (SSE2) and aarch64 (NEON) CPU has
+    static void hashLanes4(const Message* msgs, size_t count, std::array<uint32, 8>* out) {
+        hashLanes<u32x4, 4>(msgs, count, out);
+    }
+
+#if defined(SHA256_X86)
+    __attribute__((target("avx2")))
+    static void hashLanes8(const Message* msgs, size_t count, std::array<uint32, 8>* out) {
+        hashLanes<u32x8, 8>(msgs, count, out);
+    }
+
+    __attribute__((target("avx512f")))
+    static void hashLanes16(const Message* msgs, size_t count, std::array<uint32, 8>* out) {
+        hashLanes<u32x16, 16>(msgs, count, out);
+    }
+#endif
+
+    struct MultiDispatch {
+        void (*hash)(const Message* msgs, size_t count, std::array<uint32, 8>* out);
+        int lanes;
+        const char* name;
+    };
+
+    //picks the widest multi-buffer kernel the CPU (and OS) supports
+    static const MultiDispatch& multiDispatch() {
+        static const MultiDispatch d = [] {
+#if defined(SHA256_X86)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f")) return MultiDispatch{hashLanes16, 16, "avx512-16x"};
+            if (__builtin_cpu_supports("avx2")) return MultiDispatch{hashLanes8, 8, "avx2-8x"};
+            return MultiDispatch{hashLanes4, 4, "sse2-4x"};
+#elif defined(SHA256_ARM)
+            return MultiDispatch{hashLanes4, 4, "neon-4x"};
+#else
+            return MultiDispatch{nullptr, 1, "none"};
+#endif
+        }();
+        return d;
+    }
+
+    struct Dispatch {
+        TransformFn fn;
+        const char* name;
+    };
+
+    //picks the fastest compression function once, on first use
+    static Dispatch& dispatch() {
+        static Dispatch d = [] {
+#if defined(SHA256_X86)
+            if (cpuHasShaNi()) return Dispatch{transformShaNi, "x86-sha"};
+#elif defined(SHA256_ARM)
+            if (cpuHasArmv8Sha2()) return Dispatch{transformArmv8, "armv8-crypto"};
+#endif
+            return Dispatch{transformPortable, "portable"};
+        }();
+        return d;
     }
-};
 
-// "Record" is the in-memory data model for one indexed file
-// represents one complete index entry, equivalent to one line of the JSONL file for the Python indexer
-// stores all metadata collected for a single file, used in the index
-struct Record {
-    std::string filename;
-    std::string path;
-    uint64_t size;
-    uint64_t mtime;
-    std::string hash;
 };
 
-//a thread‑safe queue that distributes file indexing tasks among worker threads
-//enables parallel execution within a single process.
-class JobQueue {
+// BLAKE3 (public-domain reference algorithm), the plain hash mode with no key
+//the input is split into 1 KiB chunks that are hashed independently and joined
+//pairwise into a binary tree: consecutive chunks of one stream fill the SIMD
+//lanes, and whole subtrees of one file can be hashed on separate threads
+class BLAKE3 {
 public:
-    void push(const fs::path& p) {
-        std::lock_guard<std::mutex> lock(m_);
-        q_.push(p);
-        cv_.notify_one();
+    using Digest = std::array<uint8_t, 32>;
+    //the 8-word result of one chunk, or of a subtree of chunks
+    using ChainingValue = std::array<uint32_t, 8>;
+
+    static constexpr size_t CHUNK = 1024;
+
+    //streaming interface, as for SHA256; whole chunks are hashed straight from the
+    //caller's memory, and only the final (possibly partial) chunk is copied in
+    void update(const void* data, size_t len) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        while (len > 0) {
+            //more input follows, so a full chunk is not the last one
+            if (chunkBytes() == CHUNK) pushSubtree(chunkOutput().chainingValue(), 1);
+
+            if (chunkBytes() == 0) {
+                //several chunks per SIMD pass, always leaving at least one byte
+                //behind so the final chunk stays in the object for finalize
+                while (len > CHUNK) {
+                    const size_t avail = (len - 1) / CHUNK;
+                    const ChunkKernel& k = chunkKernel(avail);
+                    const size_t n = std::min<size_t>(k.lanes, avail);
+                    ChainingValue cvs[16];
+                    k.hash(p, n, counter_, cvs);
+                    for (size_t i = 0; i < n; ++i) pushSubtree(cvs[i], 1);
+                    p += n * CHUNK;
+                    len -= n * CHUNK;
+                }
+            }
+
+            if (blockLen_ == 64) {
+                uint32 m[16];
+                loadBlock(block_, m);
+                cv_ = compress(cv_, m, counter_, 64, startFlag());
+                ++blocks_;
+                blockLen_ = 0;
+            }
+            const size_t take = std::min(len, 64 - blockLen_);
+            std::memcpy(block_ + blockLen_, p, take);
+            blockLen_ += take;
+            p += take;
+            len -= take;
+        }
     }
 
-    bool pop(fs::path& p) {
-        std::unique_lock<std::mutex> lock(m_);
-        cv_.wait(lock, [&]{ return done_ || !q_.empty(); });
+    Digest finalize() const {
+        const Output o = topOutput();
+        const ChainingValue w = compress(o.cv, o.block, 0, o.blockLen, o.flags | ROOT);
+        Digest d;
+        for (int i = 0; i < 8; i++) {
+            d[i * 4] = w[i];
+            d[i * 4 + 1] = w[i] >> 8;
+            d[i * 4 + 2] = w[i] >> 16;
+            d[i * 4 + 3] = w[i] >> 24;
+        }
+        return d;
+    }
 
-        if (q_.empty()) return false;
-        p = q_.front();
-        q_.pop();
-        return true;
+    //chaining value of the subtree over `len` bytes that start at chunk `firstChunk`
+    //`len` must be a power-of-two number of chunks and firstChunk a multiple of it,
+    //so the subtree is one of the complete left subtrees of the whole file's tree
+    static ChainingValue subtree(const uint8_t* data, size_t len, uint64_t firstChunk) {
+        BLAKE3 h;
+        h.counter_ = firstChunk;
+        h.update(data, len);
+        return h.topOutput().chainingValue();
     }
 
-    void done() {
-        std::lock_guard<std::mutex> lock(m_);
-        done_ = true;
-        cv_.notify_all();
+    //appends a subtree made by subtree() covering the next `chunks` chunks, as if
+    //its bytes had been passed to update; only valid while no partial chunk is held,
+    //ie: on a fresh object or after other pushSubtree calls
+    void pushSubtree(ChainingValue cv, uint64_t chunks) {
+        counter_ += chunks;
+        for (uint64 total = counter_ / chunks; (total & 1) == 0; total >>= 1) {
+            cv = parentOutput(stack_[--stackLen_], cv).chainingValue();
+        }
+        stack_[stackLen_++] = cv;
+        cv_ = IV;
+        blocks_ = 0;
+        blockLen_ = 0;
     }
 
+    //name of the widest multi-chunk kernel picked for this CPU
+    static const char* implementation() { return chunkDispatch().kernels[0].name; }
+
 private:
-    std::queue<fs::path> q_;
-    std::mutex m_;
-    std::condition_variable cv_;
-    bool done_ = false;
-};
+    using uint32 = uint32_t;
+    using uint64 = uint64_t;
 
-//this method is executed by each thread
-//it repeatedly takes jobs from the shared queue and processes them until no work remains
-//it defines how each file is indexed and how the results are stored safely for variant A
-static void worker(JobQueue& jobs,
-                   std::vector<Record>& records,
-                   std::mutex& recMutex)
-{
-    fs::path p;
-    //processes jobs until the queue is empty and marked done
-    while (jobs.pop(p)) {
-        try {
-            //performs indexing for one file (CPU-bound work) eg: reading metadata and computing SHA-256 hash
-            Record r;
-            r.filename = p.filename().string();
-            r.path = p.string();
-            r.size = fs::file_size(p);
-            r.mtime = fs::last_write_time(p).time_since_epoch().count();
-            r.hash = SHA256::hashFile(p);
+    static constexpr ChainingValue IV = {0x6a09e667,0xbb67ae85,0x3c6ef372,0xa54ff53a,
+                                         0x510e527f,0x9b05688c,0x1f83d9ab,0x5be0cd19};
+
+    static constexpr uint32 CHUNK_START = 1, CHUNK_END = 2, PARENT = 4, ROOT = 8;
+
+    //message word order of each of the 7 rounds
+    static constexpr uint8_t SCHEDULE[7][16] = {
+        {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+        {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+        {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+        {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+        {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+        {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+        {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+    };
+
+    //the chunk in progress: its chaining value so far and its unhashed last block
+    ChainingValue cv_ = IV;
+    uint8_t block_[64];
+    size_t blockLen_ = 0;
+    size_t blocks_ = 0;
+    //index of the chunk in progress
+    uint64 counter_ = 0;
+    //chaining values of the complete subtrees to the left, largest first
+    ChainingValue stack_[54];
+    size_t stackLen_ = 0;
+
+    //a compression waiting to be run, either for a chaining value or as the root
+    struct Output {
+        ChainingValue cv;
+        uint32 block[16];
+        uint64 counter;
+        uint32 blockLen;
+        uint32 flags;
+
+        ChainingValue chainingValue() const { return compress(cv, block, counter, blockLen, flags); }
+    };
+
+    size_t chunkBytes() const { return blocks_ * 64 + blockLen_; }
+    uint32 startFlag() const { return blocks_ == 0 ? CHUNK_START : 0; }
+
+    Output chunkOutput() const {
+        Output o{cv_, {}, counter_, static_cast<uint32>(blockLen_), startFlag() | CHUNK_END};
+        uint8_t last[64] = {};
+        std::memcpy(last, block_, blockLen_);
+        loadBlock(last, o.block);
+        return o;
+    }
 
-            //stores the result in the shared records vector (protected by mutex)
-            std::lock_guard<std::mutex> lock(recMutex);
-            records.push_back(std::move(r));
+    static Output parentOutput(const ChainingValue& left, const ChainingValue& right) {
+        Output o{IV, {}, 0, 64, PARENT};
+        for (int i = 0; i < 8; i++) {
+            o.block[i] = left[i];
+            o.block[i + 8] = right[i];
         }
-        catch (...) {
-            // ignore unreadable files
+        return o;
+    }
+
+    //the chunk in progress folded up through every subtree on the stack
+    Output topOutput() const {
+        Output o = chunkOutput();
+        for (size_t i = stackLen_; i > 0; --i) o = parentOutput(stack_[i - 1], o.chainingValue());
+        return o;
+    }
+
+    static uint32 load32(const uint8_t* p) {
+        return uint32(p[0]) | (uint32(p[1]) << 8) | (uint32(p[2]) << 16) | (uint32(p[3]) << 24);
+    }
+
+    static void loadBlock(const uint8_t* p, uint32* m) {
+        for (int i = 0; i < 16; i++) m[i] = load32(p + i * 4);
+    }
+
+    //a macro for the same reason as SHA256_VROTR: it serves both uint32 and vectors
+#define BLAKE3_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+    template <typename V>
+    __attribute__((always_inline))
+    static inline void mix(V& a, V& b, V& c, V& d, const V& x, const V& y) {
+        a = a + b + x;
+        d = BLAKE3_ROTR(d ^ a, 16);
+        c = c + d;
+        b = BLAKE3_ROTR(b ^ c, 12);
+        a = a + b + y;
+        d = BLAKE3_ROTR(d ^ a, 8);
+        c = c + d;
+        b = BLAKE3_ROTR(b ^ c, 7);
+    }
+
+#undef BLAKE3_ROTR
+
+    //the 7 rounds over the 16-word state, columns then diagonals
+    template <typename V>
+    __attribute__((always_inline))
+    static inline void rounds(V* v, const V* m) {
+#pragma GCC unroll 7
+        for (int r = 0; r < 7; r++) {
+            const uint8_t* s = SCHEDULE[r];
+            mix(v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+            mix(v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+            mix(v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+            mix(v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+            mix(v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+            mix(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+            mix(v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+            mix(v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
         }
     }
-}
 
-//this method coordinates the overall indexing process for variant A
-//it sets up the job queue, spawns worker threads, and collects the final results
-static std::vector<Record> indexDirectory(const fs::path& root, int workers)
-{
-    JobQueue jobs;
-    std::vector<Record> records;
-    std::mutex recMutex; //protects records from concurrent writes
+    //compresses one block and returns the new chaining value
+    static ChainingValue compress(const ChainingValue& cv, const uint32* m,
+                                  uint64 counter, uint32 blockLen, uint32 flags) {
+        uint32 v[16] = {cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+                        IV[0], IV[1], IV[2], IV[3],
+                        static_cast<uint32>(counter), static_cast<uint32>(counter >> 32),
+                        blockLen, flags};
+        rounds(v, m);
+        ChainingValue out;
+        for (int i = 0; i < 8; i++) out[i] = v[i] ^ v[i + 8];
+        return out;
+    }
 
-    //spawns worker threads
-    std::vector<std::thread> threads;
-    for (int i = 0; i < workers; ++i) {
-        threads.emplace_back(worker,
-                             std::ref(jobs),
-                             std::ref(records),
-                             std::ref(recMutex));
+    //one whole chunk at a time, used when the CPU has no usable SIMD kernel
+    static void hashChunks1(const uint8_t* input, size_t count, uint64 counter, ChainingValue* out) {
+        for (size_t c = 0; c < count; ++c, input += CHUNK) {
+            ChainingValue cv = IV;
+            for (int b = 0; b < 16; b++) {
+                uint32 m[16];
+                loadBlock(input + b * 64, m);
+                cv = compress(cv, m, counter + c, 64,
+                              (b == 0 ? CHUNK_START : 0) | (b == 15 ? CHUNK_END : 0));
+            }
+            out[c] = cv;
+        }
     }
 
-    //recursively scans the directory and enqueues each file (Job instance) for processing
-    for (auto& entry : fs::recursive_directory_iterator(root)) {
-        if (entry.is_regular_file()) {
-            jobs.push(entry.path());
+    //multi-chunk BLAKE3 over GCC/Clang vector types, one chunk per lane, in the
+    //same style as SHA256's multi-buffer lanes
+    typedef uint32_t u32x4 __attribute__((vector_size(16)));
+    typedef uint32_t u32x8 __attribute__((vector_size(32)));
+    typedef uint32_t u32x16 __attribute__((vector_size(64)));
+
+    //hashes `count` (1..Lanes) whole consecutive chunks with all 16 blocks in
+    //lockstep; unused lanes repeat the first chunk and their result is dropped
+    template <typename V, int Lanes>
+    __attribute__((always_inline))
+    static inline void hashChunksLanes(const uint8_t* input, size_t count, uint64 counter, ChainingValue* out) {
+        const uint8_t* chunks[Lanes];
+        alignas(64) uint32 lo[Lanes], hi[Lanes];
+        for (int l = 0; l < Lanes; l++) {
+            const size_t c = static_cast<size_t>(l) < count ? l : 0;
+            chunks[l] = input + c * CHUNK;
+            lo[l] = static_cast<uint32>(counter + c);
+            hi[l] = static_cast<uint32>((counter + c) >> 32);
+        }
+        V counterLo, counterHi;
+        std::memcpy(&counterLo, lo, sizeof(V));
+        std::memcpy(&counterHi, hi, sizeof(V));
+
+        V cv[8];
+        for (int j = 0; j < 8; j++) cv[j] = V{} + IV[j];
+        for (int b = 0; b < 16; b++) {
+            V m[16];
+            for (int i = 0; i < 16; i++) {
+                alignas(64) uint32 words[Lanes];
+                for (int l = 0; l < Lanes; l++) words[l] = load32(chunks[l] + b * 64 + i * 4);
+                std::memcpy(&m[i], words, sizeof(V));
+            }
+            const uint32 flags = (b == 0 ? CHUNK_START : 0) | (b == 15 ? CHUNK_END : 0);
+            V v[16] = {cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+                       V{} + IV[0], V{} + IV[1], V{} + IV[2], V{} + IV[3],
+                       counterLo, counterHi, V{} + 64u, V{} + flags};
+            rounds(v, m);
+            for (int j = 0; j < 8; j++) cv[j] = v[j] ^ v[j + 8];
+        }
+        for (size_t l = 0; l < count; l++) {
+            for (int j = 0; j < 8; j++) out[l][j] = cv[j][l];
         }
     }
 
-    jobs.done();
-    for (auto& t : threads) t.join(); //waits for workers to finish
+    static void hashChunks4(const uint8_t* input, size_t count, uint64 counter, ChainingValue* out) {
+        hashChunksLanes<u32x4, 4>(input, count, counter, out);
+    }
 
-    //returns all collected records
-    //this enables CLI queries such as `find` and `checksum`
-    return records;
-}
+#if defined(SHA256_X86)
+    __attribute__((target("avx2")))
+    static void hashChunks8(const uint8_t* input, size_t count, uint64 counter, ChainingValue* out) {
+        hashChunksLanes<u32x8, 8>(input, count, counter, out);
+    }
 
-//CLI QUERY: find all files larger than a specified size in MB
-static void queryFind(const std::vector<Record>& records, uint64_t minMB)
-{
-    uint64_t threshold = minMB * 1024ULL * 1024ULL;
-    for (const auto& r : records) {
-        if (r.size > threshold) {
-            std::cout << r.path << " " << r.size << "\n";
+    __attribute__((target("avx512f")))
+    static void hashChunks16(const uint8_t* input, size_t count, uint64 counter, ChainingValue* out) {
+        hashChunksLanes<u32x16, 16>(input, count, counter, out);
+    }
+#endif
+
+    struct ChunkKernel {
+        void (*hash)(const uint8_t* input, size_t count, uint64 counter, ChainingValue* out);
+        size_t lanes;
+        const char* name;
+    };
+
+    //the kernels the CPU (and OS) supports, widest first, ending with the scalar one
+    struct ChunkDispatch {
+        ChunkKernel kernels[4];
+        size_t count;
+    };
+
+    static const ChunkDispatch& chunkDispatch() {
+        static const ChunkDispatch d = [] {
+            const ChunkKernel scalar{hashChunks1, 1, "portable"};
+#if defined(SHA256_X86)
+            const ChunkKernel sse2{hashChunks4, 4, "sse2-4x"};
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f")) {
+                return ChunkDispatch{{{hashChunks16, 16, "avx512-16x"}, {hashChunks8, 8, "avx2-8x"}, sse2, scalar}, 4};
+            }
+            if (__builtin_cpu_supports("avx2")) return ChunkDispatch{{{hashChunks8, 8, "avx2-8x"}, sse2, scalar}, 3};
+            return ChunkDispatch{{sse2, scalar}, 2};
+#elif defined(SHA256_ARM)
+            return ChunkDispatch{{{hashChunks4, 4, "neon-4x"}, scalar}, 2};
+#else
+            return ChunkDispatch{{scalar}, 1};
+#endif
+        }();
+        return d;
+    }
+
+    //the widest kernel whose lanes `avail` chunks can all fill
+    static const ChunkKernel& chunkKernel(size_t avail) {
+        const ChunkDispatch& d = chunkDispatch();
+        for (size_t i = 0; i + 1 < d.count; ++i) {
+            if (d.kernels[i].lanes <= avail) return d.kernels[i];
         }
+        return d.kernels[d.count - 1];
     }
-}
 
-//CLI QUERY: get the SHA-256 checksum of a specified filename
-static void queryChecksum(const std::vector<Record>& records,
-                          const std::string& filename)
-{
-    for (const auto& r : records) {
-        if (r.filename == filename) {
-            std::cout << r.hash << "\n";
+};
+
+// XXH3, 64-bit variant with the default secret and seed (xxHash, BSD-2-Clause)
+//a non-cryptographic fingerprint several times cheaper than SHA-256: reliable
+//for noticing that a file changed, no defence against deliberate collisions
+class XXH3 {
+public:
+    using Digest = uint64_t;
+
+    void update(const void* data, size_t len) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        total_ += len;
+        if (len <= BUFFER - bufLen_) {
+            std::memcpy(buf_ + bufLen_, p, len);
+            bufLen_ += len;
             return;
         }
+        if (bufLen_ > 0) {
+            const size_t fill = BUFFER - bufLen_;
+            std::memcpy(buf_ + bufLen_, p, fill);
+            p += fill;
+            len -= fill;
+            consumeStripes(acc_, stripes_, buf_, BUFFER / STRIPE);
+            bufLen_ = 0;
+        }
+        if (len > BUFFER) {
+            //stripes straight from the caller's memory, keeping the last byte(s) back;
+            //the last whole stripe is saved in case the final input is shorter than one
+            const size_t n = (len - 1) / STRIPE;
+            consumeStripes(acc_, stripes_, p, n);
+            p += n * STRIPE;
+            len -= n * STRIPE;
+            std::memcpy(buf_ + BUFFER - STRIPE, p - STRIPE, STRIPE);
+        }
+        std::memcpy(buf_, p, len);
+        bufLen_ = len;
     }
-    std::cout << "File not found\n";
-}
 
-//entrypoint
-int main(int argc, char* argv[])
-{
-    if (argc < 3) {
-        std::cerr <<
-          "Usage:\n"
-          "  index <root> [workers]\n"
-          "  find <root> <MB>\n"
-          "  checksum <root> <filename>\n";
-        return 1;
+    Digest finalize() const {
+        if (total_ <= MIDSIZE_MAX) return hashShort(buf_, static_cast<size_t>(total_));
+
+        uint64 acc[8];
+        std::memcpy(acc, acc_, sizeof(acc));
+        size_t stripes = stripes_;
+        uint8_t last[STRIPE];
+        const uint8_t* lastStripe;
+        if (bufLen_ >= STRIPE) {
+            consumeStripes(acc, stripes, buf_, (bufLen_ - 1) / STRIPE);
+            lastStripe = buf_ + bufLen_ - STRIPE;
+        }
+        else {
+            const size_t catchup = STRIPE - bufLen_;
+            std::memcpy(last, buf_ + BUFFER - catchup, catchup);
+            std::memcpy(last + catchup, buf_, bufLen_);
+            lastStripe = last;
+        }
+        accumulate(acc, lastStripe, SECRET + SECRET_LIMIT - 7);
+        return mergeAccs(acc, SECRET + 11, total_ * P64_1);
     }
 
-    std::string mode = argv[1];
-    fs::path root = argv[2];
+private:
+    using uint32 = uint32_t;
+    using uint64 = uint64_t;
 
-    int workers = (argc >= 4 && mode == "index")
-                    ? std::stoi(argv[3])
-                    : 4;
+    static constexpr uint64 P32_1 = 0x9E3779B1U, P32_2 = 0x85EBCA77U, P32_3 = 0xC2B2AE3DU;
+    static constexpr uint64 P64_1 = 0x9E3779B185EBCA87ULL, P64_2 = 0xC2B2AE3D27D4EB4FULL,
+                            P64_3 = 0x165667B19E3779F9ULL, P64_4 = 0x85EBCA77C2B2AE63ULL,
+                            P64_5 = 0x27D4EB2F165667C5ULL;
+    static constexpr uint64 MX1 = 0x165667919E3779F9ULL, MX2 = 0x9FB21C651E98DF25ULL;
 
-    auto records = indexDirectory(root, workers);
+    static constexpr size_t STRIPE = 64;
+    static constexpr size_t BUFFER = 256;
+    static constexpr size_t MIDSIZE_MAX = 240;
+    //default 192-byte secret: 16 stripes per block, scrambled with its last 64 bytes
+    static constexpr size_t SECRET_LIMIT = 192 - STRIPE;
+    static constexpr size_t STRIPES_PER_BLOCK = SECRET_LIMIT / 8;
 
-    if (mode == "find") {
-        queryFind(records, std::stoull(argv[3]));
+    static constexpr uint8_t SECRET[192] = {
+        0xb8,0xfe,0x6c,0x39,0x23,0xa4,0x4b,0xbe,0x7c,0x01,0x81,0x2c,0xf7,0x21,0xad,0x1c,
+        0xde,0xd4,0x6d,0xe9,0x83,0x90,0x97,0xdb,0x72,0x40,0xa4,0xa4,0xb7,0xb3,0x67,0x1f,
+        0xcb,0x79,0xe6,0x4e,0xcc,0xc0,0xe5,0x78,0x82,0x5a,0xd0,0x7d,0xcc,0xff,0x72,0x21,
+        0xb8,0x08,0x46,0x74,0xf7,0x43,0x24,0x8e,0xe0,0x35,0x90,0xe6,0x81,0x3a,0x26,0x4c,
+        0x3c,0x28,0x52,0xbb,0x91,0xc3,0x00,0xcb,0x88,0xd0,0x65,0x8b,0x1b,0x53,0x2e,0xa3,
+        0x71,0x64,0x48,0x97,0xa2,0x0d,0xf9,0x4e,0x38,0x19,0xef,0x46,0xa9,0xde,0xac,0xd8,
+        0xa8,0xfa,0x76,0x3f,0xe3,0x9c,0x34,0x3f,0xf9,0xdc,0xbb,0xc7,0xc7,0x0b,0x4f,0x1d,
+        0x8a,0x51,0xe0,0x4b,0xcd,0xb4,0x59,0x31,0xc8,0x9f,0x7e,0xc9,0xd9,0x78,0x73,0x64,
+        0xea,0xc5,0xac,0x83,0x34,0xd3,0xeb,0xc3,0xc5,0x81,0xa0,0xff,0xfa,0x13,0x63,0xeb,
+        0x17,0x0d,0xdd,0x51,0xb7,0xf0,0xda,0x49,0xd3,0x16,0x55,0x26,0x29,0xd4,0x68,0x9e,
+        0x2b,0x16,0xbe,0x58,0x7d,0x47,0xa1,0xfc,0x8f,0xf8,0xb8,0xd1,0x7a,0xd0,0x31,0xce,
+        0x45,0xcb,0x3a,0x8f,0x95,0x16,0x04,0x28,0xaf,0xd7,0xfb,0xca,0xbb,0x4b,0x40,0x7e,
+    };
+
+    uint64 acc_[8] = {P32_3, P64_1, P64_2, P64_3, P64_4, P32_2, P64_5, P32_1};
+    //stripes accumulated since the last scramble
+    size_t stripes_ = 0;
+    //input not yet accumulated; always holds at least one byte once anything was fed
+    uint8_t buf_[BUFFER];
+    size_t bufLen_ = 0;
+    uint64 total_ = 0;
+
+    //XXH3 reads its input as little-endian words
+    static uint64 load64(const uint8_t* p) {
+        uint64 v;
+        std::memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        v = __builtin_bswap64(v);
+#endif
+        return v;
     }
-    else if (mode == "checksum") {
-        queryChecksum(records, argv[3]);
+
+    static uint32 load32(const uint8_t* p) {
+        uint32 v;
+        std::memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        v = __builtin_bswap32(v);
+#endif
+        return v;
     }
 
-    return 0;
-}
\ No newline at end of file
+    static uint64 rotl(uint64 x, int n) { return (x << n) | (x >> (64 - n)); }
+
+    static uint64 mulFold(uint64 a, uint64 b) {
+        const unsigned __int128 r = static_cast<unsigned __int128>(a) * b;
+        return static_cast<uint64>(r) ^ static_cast<uint64>(r >> 64);
+    }
+
+    static uint64 avalanche(uint64 h) {
+        h ^= h >> 37;
+        h *= MX1;
+        return h ^ (h >> 32);
+    }
+
+    static uint64 avalanche64(uint64 h) {
+        h ^= h >> 33;
+        h *= P64_2;
+        h ^= h >> 29;
+        h *= P64_3;
+        return h ^ (h >> 32);
+    }
+
+    static uint64 rrmxmx(uint64 h, uint64 len) {
+        h ^= rotl(h, 49) ^ rotl(h, 24);
+        h *= MX2;
+        h ^= (h >> 35) + len;
+        h *= MX2;
+        return h ^ (h >> 28);
+    }
+
+    static uint64 mix16(const uint8_t* in, const uint8_t* secret) {
+        return mulFold(load64(in) ^ load64(secret), load64(in + 8) ^ load64(secret + 8));
+    }
+
+    //inputs of up to 240 bytes each have their own mixing, with no accumulators
+    static Digest hashShort(const uint8_t* in, size_t len) {
+        const uint8_t* s = SECRET;
+        if (len == 0) return avalanche64(load64(s + 56) ^ load64(s + 64));
+        if (len <= 3) {
+            const uint32 combined = (uint32(in[0]) << 16) | (uint32(in[len >> 1]) << 24) |
+                                    uint32(in[len - 1]) | (uint32(len) << 8);
+            return avalanche64(combined ^ uint64(load32(s) ^ load32(s + 4)));
+        }
+        if (len <= 8) {
+            const uint64 input64 = load32(in + len - 4) + (uint64(load32(in)) << 32);
+            return rrmxmx(input64 ^ (load64(s + 8) ^ load64(s + 16)), len);
+        }
+        if (len <= 16) {
+            const uint64 lo = load64(in) ^ (load64(s + 24) ^ load64(s + 32));
+            const uint64 hi = load64(in + len - 8) ^ (load64(s + 40) ^ load64(s + 48));
+            return avalanche(len + __builtin_bswap64(lo) + hi + mulFold(lo, hi));
+        }
+        uint64 acc = len * P64_1;
+        if (len <= 128) {
+            for (size_t i = (len - 1) / 32 + 1; i > 0; --i) {
+                acc += mix16(in + 16 * (i - 1), s + 32 * (i - 1));
+                acc += mix16(in + len - 16 * i, s + 32 * (i - 1) + 16);
+            }
+            return avalanche(acc);
+        }
+        for (size_t i = 0; i < 8; i++) acc += mix16(in + 16 * i, s + 16 * i);
+        uint64 accEnd = mix16(in + len - 16, s + 136 - 17);
+        acc = avalanche(acc);
+        for (size_t i = 8; i < len / 16; i++) accEnd += mix16(in + 16 * i, s + 16 * (i - 8) + 3);
+        return avalanche(acc + accEnd);
+    }
+
+    static void accumulate(uint64* acc, const uint8_t* in, const uint8_t* secret) {
+        for (int i = 0; i < 8; i++) {
+            const uint64 v = load64(in + 8 * i);
+            const uint64 k = v ^ load64(secret + 8 * i);
+            acc[i ^ 1] += v;
+            acc[i] += (k & 0xffffffff) * (k >> 32);
+        }
+    }
+
+    static void scramble(uint64* acc, const uint8_t* secret) {
+        for (int i = 0; i < 8; i++) {
+            acc[i] = (acc[i] ^ (acc[i] >> 47) ^ load64(secret + 8 * i)) * P32_1;
+        }
+    }
+
+    //accumulates `n` stripes, scrambling the accumulators after every full block
+    static void consumeStripes(uint64* acc, size_t& soFar, const uint8_t* p, size_t n) {
+        while (n > 0) {
+            const size_t take = std::min(n, STRIPES_PER_BLOCK - soFar);
+            for (size_t i = 0; i < take; i++) accumulate(acc, p + i * STRIPE, SECRET + (soFar + i) * 8);
+            p += take * STRIPE;
+            n -= take;
+            soFar += take;
+            if (soFar == STRIPES_PER_BLOCK) {
+                scramble(acc, SECRET + SECRET_LIMIT);
+                soFar = 0;
+            }
+        }
+    }
+
+    static Digest mergeAccs(const uint64* acc, const uint8_t* secret, uint64 start) {
+        for (int i = 0; i < 4; i++) {
+            start += mulFold(acc[2 * i] ^ load64(secret + 16 * i), acc[2 * i + 1] ^ load64(secret + 16 * i + 8));
+        }
+        return avalanche(start);
+    }
+};
+
+//a file's content digest as kept in memory and in the index: up to 32 raw bytes,
+//hex-encoded only where it is printed
+struct FileDigest {
+    std::array<uint8_t, 32> bytes{};
+    //bytes used: 32 for SHA-256 and BLAKE3, 8 for XXH3, 0 if the file could not be read
+    uint8_t len = 0;
+
+    FileDigest() = default;
+    explicit FileDigest(const std::array<uint8_t, 32>& d) : bytes(d), len(32) {}
+    //XXH3 in its canonical big-endian byte order
+    explicit FileDigest(uint64_t d) : len(8) {
+        for (int i = 7; i >= 0; i--, d >>= 8) bytes[i] = d & 0xff;
+    }
+
+    std::string hex() const {
+        static const char digits[] = "0123456789abcdef";
+        std::string out(len * 2, '0');
+        for (size_t i = 0; i < len; i++) {
+            out[i * 2] = digits[bytes[i] >> 4];
+            out[i * 2 + 1] = digits[bytes[i] & 0xf];
+        }
+        return out;
+    }
+
+    //parses a hex digest as written by hex(); "" is an empty digest
+    static bool fromHex(const std::string& s, FileDigest& d) {
+        auto nibble = [](char c) {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            return -1;
+        };
+        if (s.size() % 2 != 0 || s.size() > d.bytes.size() * 2) return false;
+        d = FileDigest();
+        for (size_t i = 0; i < s.size() / 2; i++) {
+            const int hi = nibble(s[i * 2]), lo = nibble(s[i * 2 + 1]);
+            if (hi < 0 || lo < 0) return false;
+            d.bytes[i] = static_cast<uint8_t>(hi << 4 | lo);
+        }
+        d.len = static_cast<uint8_t>(s.size() / 2);
+        return true;
+    }
+};
+
+// "Record" is the in-memory data model for one indexed file
+// represents one complete index entry, equivalent to one line of the JSONL file for the Python indexer
+// stores all metadata collected for a single file, used in the index
+//records are kept in a RecordStore: the path lives in the store's arena, the
+//filename is the last nameLen bytes of the path, and the hash is the raw digest,
+//so one record costs 64 bytes plus its path
+struct Record {
+    uint64_t size;
+    uint64_t mtime;
+    //the path's arena chunk, its offset within the chunk, and its length
+    uint32_t pathChunk;
+    uint32_t pathOffset;
+    uint32_t pathLen;
+    uint16_t nameLen;
+    FileDigest digest;
+};
+
+//every record of one index, with the path bytes packed into an arena of 1 MB
+//chunks; chunks never move, so paths stay valid as the store grows, and merging
+//stores moves their chunks across instead of copying any path
+class RecordStore {
+public:
+    size_t size() const { return records_.size(); }
+    bool empty() const { return records_.empty(); }
+    void reserve(size_t n) { records_.reserve(n); }
+
+    Record& operator[](size_t i) { return records_[i]; }
+    const Record& operator[](size_t i) const { return records_[i]; }
+    std::vector<Record>::const_iterator begin() const { return records_.begin(); }
+    std::vector<Record>::const_iterator end() const { return records_.end(); }
+
+    std::string_view path(const Record& r) const {
+        return {chunks_[r.pathChunk].get() + r.pathOffset, r.pathLen};
+    }
+    std::string_view filename(const Record& r) const {
+        return path(r).substr(r.pathLen - r.nameLen);
+    }
+
+    //appends a record for the file at `path`, with an empty digest
+    Record& add(std::string_view path, uint64_t size, uint64_t mtime) {
+        if (path.size() > CHUNK - used_) {
+            //a path longer than a whole chunk (never in practice) gets a chunk of its own
+            chunks_.emplace_back(new char[std::max(CHUNK, path.size())]);
+            used_ = 0;
+        }
+        Record r;
+        r.size = size;
+        r.mtime = mtime;
+        r.pathChunk = static_cast<uint32_t>(chunks_.size() - 1);
+        r.pathOffset = static_cast<uint32_t>(used_);
+        r.pathLen = static_cast<uint32_t>(path.size());
+        const size_t slash = path.find_last_of('/');
+        r.nameLen = static_cast<uint16_t>(slash == std::string_view::npos ? path.size()
+                                                                          : path.size() - slash - 1);
+        std::memcpy(chunks_.back().get() + used_, path.data(), path.size());
+        //an oversized chunk is full once its path is in
+        used_ = std::min(CHUNK, used_ + path.size());
+        records_.push_back(r);
+        return records_.back();
+    }
+
+    //moves every record of `other` to the end of this store, emptying `other`
+    void append(RecordStore&& other) {
+        const uint32_t base = static_cast<uint32_t>(chunks_.size());
+        const size_t first = records_.size();
+        records_.insert(records_.end(), other.records_.begin(), other.records_.end());
+        for (size_t i = first; i < records_.size(); ++i) records_[i].pathChunk += base;
+        //other's last chunk becomes the one new paths go into
+        if (!other.chunks_.empty()) used_ = other.used_;
+        for (auto& c : other.chunks_) chunks_.push_back(std::move(c));
+        other = RecordStore();
+    }
+
+    //drops every record, keeping one path chunk to fill again
+    void clear() {
+        records_.clear();
+        if (chunks_.size() > 1) chunks_.resize(1);
+        used_ = chunks_.empty() ? CHUNK : 0;
+    }
+
+private:
+    static constexpr size_t CHUNK = 1 << 20;
+
+    std::vector<Record> records_;
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    //bytes used in the last chunk; CHUNK when there is no chunk yet
+    size_t used_ = CHUNK;
+};
+
+//result of a non-blocking pop: a job, nothing right now, or no more jobs ever
+enum class TryPop { Job, Empty, Done };
+
+//a thread‑safe queue that distributes file indexing tasks among worker threads
+//enables parallel execution within a single process.
+//jobs move in batches: the producer pushes many paths under one lock, and each
+//worker's Consumer takes a share of the queue at once, so the lock, the wake-up
+//and the path copy are paid per batch rather than per file
+class JobQueue {
+public:
+    //one file to index; size is 0 when the producer did not look it up
+    struct Job {
+        fs::path path;
+        uint64_t size = 0;
+    };
+
+    //with a `capacity`, push blocks while that many jobs are queued, so a producer
+    //listing faster than the workers index holds back instead of queueing the tree
+    explicit JobQueue(size_t consumers = 1, size_t capacity = SIZE_MAX)
+        : consumers_(std::max<size_t>(1, consumers)), capacity_(std::max<size_t>(1, capacity)) {}
+
+    void push(fs::path p, uint64_t size = 0) {
+        std::unique_lock<std::mutex> lock(m_);
+        waitForSpace(lock);
+        q_.push_back({std::move(p), size});
+        if (waiting_ > 0) cv_.notify_one();
+    }
+
+    //moves every job out of `batch`, leaving it empty for reuse
+    void push(std::vector<Job>& batch) {
+        if (batch.empty()) return;
+        std::unique_lock<std::mutex> lock(m_);
+        waitForSpace(lock);
+        for (auto& j : batch) q_.push_back(std::move(j));
+        batch.clear();
+        if (waiting_ > 1) cv_.notify_all();
+        else if (waiting_ > 0) cv_.notify_one();
+    }
+
+    bool pop(fs::path& p) {
+        std::unique_lock<std::mutex> lock(m_);
+        waitForJobs(lock);
+
+        if (q_.empty()) return false;
+        p = std::move(q_.front().path);
+        q_.pop_front();
+        madeSpace();
+        return true;
+    }
+
+    //moves up to `max` jobs into `out`, but no more than a fair share of what is
+    //queued, so the last jobs still spread over all consumers, and no more than
+    //BATCH_BYTES of known file sizes, so large files are handed out one at a time
+    //blocks until there is work; false once the queue is empty and done
+    bool popBatch(std::vector<fs::path>& out, size_t max) {
+        std::unique_lock<std::mutex> lock(m_);
+        waitForJobs(lock);
+        return takeBatch(out, max);
+    }
+
+    //non-blocking pop, for workers that have other work in flight
+    TryPop tryPop(fs::path& p) {
+        std::lock_guard<std::mutex> lock(m_);
+        if (q_.empty()) return done_ ? TryPop::Done : TryPop::Empty;
+        p = std::move(q_.front().path);
+        q_.pop_front();
+        madeSpace();
+        return TryPop::Job;
+    }
+
+    TryPop tryPopBatch(std::vector<fs::path>& out, size_t max) {
+        std::lock_guard<std::mutex> lock(m_);
+        if (q_.empty()) return done_ ? TryPop::Done : TryPop::Empty;
+        takeBatch(out, max);
+        return TryPop::Job;
+    }
+
+    void done() {
+        std::lock_guard<std::mutex> lock(m_);
+        done_ = true;
+        cv_.notify_all();
+    }
+
+    //jobs waiting, not counting those already taken into a Consumer's batch
+    size_t depth() {
+        std::lock_guard<std::mutex> lock(m_);
+        return q_.size();
+    }
+
+    //one worker's end of the queue: pops come from a local batch, refilled with
+    //popBatch when it runs dry. pop/tryPop match JobQueue itself
+    class Consumer {
+    public:
+        static constexpr size_t BATCH = 64;
+
+        explicit Consumer(JobQueue& q) : q_(q) { local_.reserve(BATCH); }
+
+        bool pop(fs::path& p) {
+            if (local_.empty() && !q_.popBatch(local_, BATCH)) return false;
+            return next(p);
+        }
+
+        TryPop tryPop(fs::path& p) {
+            if (local_.empty()) {
+                TryPop got = q_.tryPopBatch(local_, BATCH);
+                if (got != TryPop::Job) return got;
+            }
+            next(p);
+            return TryPop::Job;
+        }
+
+    private:
+        //the batch is kept in queue order, reversed, so the oldest job pops first
+        bool next(fs::path& p) {
+            p = std::move(local_.back());
+            local_.pop_back();
+            return true;
+        }
+
+        JobQueue& q_;
+        std::vector<fs::path> local_;
+    };
+
+private:
+    void waitForJobs(std::unique_lock<std::mutex>& lock) {
+        ++waiting_;
+        cv_.wait(lock, [&]{ return done_ || !q_.empty(); });
+        --waiting_;
+    }
+
+    //a batch push may overshoot the capacity by one batch; that keeps batches whole
+    void waitForSpace(std::unique_lock<std::mutex>& lock) {
+        if (q_.size() < capacity_) return;
+        ++blocked_;
+        space_.wait(lock, [&]{ return q_.size() < capacity_; });
+        --blocked_;
+    }
+
+    void madeSpace() {
+        if (blocked_ > 0 && q_.size() < capacity_) space_.notify_all();
+    }
+
+    static constexpr uint64_t BATCH_BYTES = 1 << 20;
+
+    bool takeBatch(std::vector<fs::path>& out, size_t max) {
+        if (q_.empty()) return false;
+        size_t n = std::min({max, q_.size(), std::max<size_t>(1, q_.size() / consumers_)});
+        uint64_t bytes = 0;
+        for (size_t i = 0; i < n; ++i) {
+            bytes += q_[i].size;
+            if (bytes >= BATCH_BYTES) {
+                n = i + 1;
+                break;
+            }
+        }
+        const size_t base = out.size();
+        out.resize(base + n);
+        for (size_t i = n; i > 0; --i) {
+            out[base + i - 1] = std::move(q_.front().path);
+            q_.pop_front();
+        }
+        madeSpace();
+        return true;
+    }
+
+    std::deque<Job> q_;
+    std::mutex m_;
+    std::condition_variable cv_;
+    std::condition_variable space_;
+    size_t consumers_;
+    size_t capacity_;
+    size_t waiting_ = 0;
+    size_t blocked_ = 0;
+    bool done_ = false;
+};
+
+//work-stealing scheduler for parallel traversal: directories and files are both
+//tasks, so enumerating the tree is spread over the same threads that hash it
+//each worker owns a deque; it pops its own tasks from the back and, when that is
+//empty, steals from the front of the others. a directory task is run inside pop:
+//the thread lists the directory, pushing subdirectories first and files last, so
+//the owner keeps hashing files while idle threads steal whole subtrees
+class TaskScheduler {
+public:
+    explicit TaskScheduler(int workers)
+        : deques_(static_cast<size_t>(std::max(1, workers))) {}
+
+    void pushRoot(const fs::path& root) { push(0, {root, true}); }
+
+    //the per-thread view handed to a worker loop; pop/tryPop match JobQueue
+    class Worker {
+    public:
+        Worker(TaskScheduler& s, size_t id) : s_(s), id_(id) {}
+        bool pop(fs::path& p) { return s_.pop(id_, p, true) == TryPop::Job; }
+        TryPop tryPop(fs::path& p) { return s_.pop(id_, p, false); }
+
+    private:
+        TaskScheduler& s_;
+        size_t id_;
+    };
+
+    Worker worker(size_t id) { return Worker(*this, id % deques_.size()); }
+
+    //time spent listing directories so far, summed over the threads
+    uint64_t traversalNanos() const { return listNs_.load(); }
+
+    //files and directories waiting in the deques
+    size_t depth() const { return static_cast<size_t>(std::max<int64_t>(0, queued_.load())); }
+
+private:
+    struct Task {
+        fs::path path;
+        bool isDir;
+    };
+
+    struct Deque {
+        std::mutex m;
+        std::deque<Task> tasks;
+    };
+
+    void push(size_t id, Task&& t) {
+        pending_.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(deques_[id].m);
+            deques_[id].tasks.push_back(std::move(t));
+        }
+        queued_.fetch_add(1);
+    }
+
+    //pushes a whole directory listing under one lock and one pair of counter updates
+    void push(size_t id, std::vector<Task>& tasks) {
+        if (tasks.empty()) return;
+        const int64_t n = static_cast<int64_t>(tasks.size());
+        pending_.fetch_add(n);
+        {
+            std::lock_guard<std::mutex> lock(deques_[id].m);
+            for (auto& t : tasks) deques_[id].tasks.push_back(std::move(t));
+        }
+        queued_.fetch_add(n);
+        tasks.clear();
+    }
+
+    bool take(size_t id, Task& t) {
+        //own deque first, newest task
+        {
+            Deque& d = deques_[id];
+            std::lock_guard<std::mutex> lock(d.m);
+            if (!d.tasks.empty()) {
+                t = std::move(d.tasks.back());
+                d.tasks.pop_back();
+                queued_.fetch_sub(1);
+                return true;
+            }
+        }
+        //then steal the oldest half (up to STEAL_MAX) of another worker's tasks:
+        //one is run now, the rest go on our own deque so the next pops stay local
+        for (size_t k = 1; k < deques_.size(); ++k) {
+            Deque& d = deques_[(id + k) % deques_.size()];
+            std::vector<Task> stolen;
+            {
+                std::lock_guard<std::mutex> lock(d.m);
+                if (d.tasks.empty()) continue;
+                const size_t n = std::min(STEAL_MAX, (d.tasks.size() + 1) / 2);
+                stolen.reserve(n);
+                for (size_t i = 0; i < n; ++i) {
+                    stolen.push_back(std::move(d.tasks.front()));
+                    d.tasks.pop_front();
+                }
+            }
+            t = std::move(stolen.front());
+            queued_.fetch_sub(1);
+            if (stolen.size() > 1) {
+                std::lock_guard<std::mutex> lock(deques_[id].m);
+                //reversed, so the oldest stolen task is the next one popped from the back
+                for (size_t i = stolen.size() - 1; i > 0; --i) {
+                    deques_[id].tasks.push_back(std::move(stolen[i]));
+                }
+            }
+            return true;
+        }
+        return false;
+    }
+
+    static constexpr size_t STEAL_MAX = 32;
+
+    //lists one directory onto worker `id`'s deque
+    //unreadable directories are skipped, like unreadable files
+    void expand(size_t id, const fs::path& dir) {
+        const auto started = std::chrono::steady_clock::now();
+        std::vector<Task> dirs, files;
+        try {
+            for (auto& entry : fs::directory_iterator(dir)) {
+                std::error_code ec;
+                if (entry.is_directory(ec) && !entry.is_symlink(ec)) {
+                    dirs.push_back({entry.path(), true});
+                }
+                else if (entry.is_regular_file(ec)) {
+                    files.push_back({entry.path(), false});
+                }
+            }
+        }
+        catch (const fs::filesystem_error&) {
+            // ignore unreadable directories
+        }
+        listNs_.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now() - started).count(),
+                          std::memory_order_relaxed);
+        if (dirs.empty() && files.empty()) return;
+        push(id, dirs);
+        push(id, files);
+        std::lock_guard<std::mutex> lock(idleMutex_);
+        idle_.notify_all();
+    }
+
+    //one task for worker `id`, scanning any directories it comes across
+    //`wait` blocks while other threads are still scanning and may produce more
+    TryPop pop(size_t id, fs::path& p, bool wait) {
+        Task t;
+        for (;;) {
+            if (take(id, t)) {
+                if (!t.isDir) {
+                    p = std::move(t.path);
+                    finishTask();
+                    return TryPop::Job;
+                }
+                expand(id, t.path);
+                finishTask();
+                continue;
+            }
+            if (pending_.load() == 0) return TryPop::Done;
+            if (!wait) return TryPop::Empty;
+
+            std::unique_lock<std::mutex> lock(idleMutex_);
+            idle_.wait(lock, [&] { return queued_.load() > 0 || pending_.load() == 0; });
+        }
+    }
+
+    //a task has left the scheduler: a file handed out, or a directory fully listed
+    void finishTask() {
+        if (pending_.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(idleMutex_);
+            idle_.notify_all();
+        }
+    }
+
+    std::vector<Deque> deques_;
+    //tasks queued or being expanded; zero means the traversal is complete
+    std::atomic<int64_t> pending_{0};
+    //tasks sitting in the deques, which idle threads wait for
+    std::atomic<int64_t> queued_{0};
+    std::atomic<uint64_t> listNs_{0};
+    std::mutex idleMutex_;
+    std::condition_variable idle_;
+};
+
+//how file contents are read for hashing
+struct ReadOptions {
+    //files at least this large are memory-mapped instead of read in chunks
+    //0 never maps
+    uint64_t mmapThreshold = 16ULL << 20;
+
+    //Sync: each worker blocks in one read at a time
+    //Uring: each worker keeps many reads in flight through its own io_uring (Linux)
+    enum class Engine { Sync, Uring };
+    Engine engine = Engine::Sync;
+    //io_uring: files in flight per worker, and the size of each read
+    unsigned uringDepth = 32;
+    size_t uringChunk = 256 * 1024;
+
+    //what reading does to the page cache
+    //Keep: plain buffered reads, the files stay cached
+    //Drop: buffered reads with sequential readahead, and every file is dropped
+    //from the cache once read, so indexing does not evict other programs' pages
+    //Direct: files read in chunks bypass the cache with O_DIRECT (buffered, as
+    //with Drop, where the filesystem refuses it); small batched files, mapped
+    //files and the pipeline's reads are buffered as with Drop
+    enum class Cache { Keep, Drop, Direct };
+    Cache cache = Cache::Keep;
+    //bytes per read call for files read in chunks without io_uring
+    size_t readSize = 64 * 1024;
+};
+
+//the alignment O_DIRECT needs for buffers, offsets and lengths; the logical
+//block size of every common filesystem divides it
+static constexpr size_t DIRECT_ALIGN = 4096;
+
+//a heap buffer aligned for O_DIRECT; resizing keeps neither the old contents
+//nor a smaller allocation's memory
+class IoBuffer {
+public:
+    IoBuffer() = default;
+    explicit IoBuffer(size_t size) { resize(size); }
+
+    void resize(size_t size) {
+        size_ = size;
+        if (size <= capacity_) return;
+        capacity_ = (size + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+        data_.reset(static_cast<uint8_t*>(std::aligned_alloc(DIRECT_ALIGN, capacity_)));
+        if (!data_) {
+            capacity_ = size_ = 0;
+            throw std::bad_alloc();
+        }
+    }
+
+    uint8_t* data() { return data_.get(); }
+    size_t size() const { return size_; }
+
+private:
+    struct Free {
+        void operator()(uint8_t* p) const { std::free(p); }
+    };
+    std::unique_ptr<uint8_t, Free> data_;
+    size_t size_ = 0;
+    size_t capacity_ = 0;
+};
+
+//opens `p` for reading under ro.cache; `direct` asks for O_DIRECT, and is left
+//true only if the file was opened that way: the policy must be Direct and the
+//filesystem must accept it (tmpfs, for one, does not)
+static int openForRead(const fs::path& p, const ReadOptions& ro, bool& direct)
+{
+    direct = direct && ro.cache == ReadOptions::Cache::Direct;
+#if defined(O_DIRECT)
+    if (direct) {
+        int fd = ::open(p.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+        if (fd >= 0 || errno != EINVAL) return fd;
+    }
+#endif
+    direct = false;
+    int fd = ::open(p.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0 && ro.cache != ReadOptions::Cache::Keep) ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return fd;
+}
+
+//closes a file opened by openForRead, first dropping its pages from the cache
+//unless the policy keeps them; errno is left as the reads set it
+static void closeAfterRead(int fd, const ReadOptions& ro)
+{
+    const int error = errno;
+    if (ro.cache != ReadOptions::Cache::Keep) ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+    errno = error;
+}
+
+//the content hash recorded for each file; names match the Python indexer's --hash
+enum class HashAlgo { Sha256, Blake3, Xxh3 };
+
+static const char* hashAlgoName(HashAlgo algo)
+{
+    switch (algo) {
+    case HashAlgo::Blake3: return "blake3";
+    case HashAlgo::Xxh3: return "xxh3";
+    default: return "sha256";
+    }
+}
+
+static bool parseHashAlgo(const std::string& name, HashAlgo& algo)
+{
+    for (HashAlgo a : {HashAlgo::Sha256, HashAlgo::Blake3, HashAlgo::Xxh3}) {
+        if (name == hashAlgoName(a)) {
+            algo = a;
+            return true;
+        }
+    }
+    return false;
+}
+
+//how file contents are hashed
+struct HashOptions {
+    HashAlgo algo = HashAlgo::Sha256;
+    //BLAKE3 only: files at least this large are split into subtrees hashed by
+    //treeThreads threads at once; 0 (or a single thread) hashes every file on one thread
+    //indexing runs default to a share of the cores per worker, see indexConfig
+    uint64_t treeThreshold = 64ULL << 20;
+    unsigned treeThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    //whether a file of `size` bytes is hashed as a parallel BLAKE3 tree
+    bool treeHashes(uint64_t size) const {
+        return algo == HashAlgo::Blake3 && treeThreshold > 0 && treeThreads > 1 &&
+               size >= treeThreshold;
+    }
+};
+
+//one streaming hash of a file's contents, whichever algorithm was chosen
+class Hasher {
+public:
+    virtual ~Hasher() = default;
+    virtual void update(const void* data, size_t len) = 0;
+    //digest of everything passed to update; call once
+    virtual FileDigest finalize() = 0;
+};
+
+template <typename H>
+class HasherOf final : public Hasher {
+public:
+    void update(const void* data, size_t len) override { h_.update(data, len); }
+    FileDigest finalize() override { return FileDigest(h_.finalize()); }
+
+private:
+    H h_;
+};
+
+static std::unique_ptr<Hasher> makeHasher(HashAlgo algo)
+{
+    switch (algo) {
+    case HashAlgo::Blake3: return std::make_unique<HasherOf<BLAKE3>>();
+    case HashAlgo::Xxh3: return std::make_unique<HasherOf<XXH3>>();
+    default: return std::make_unique<HasherOf<SHA256>>();
+    }
+}
+
+//digest of one buffer already in memory
+static FileDigest hashBuffer(HashAlgo algo, const uint8_t* data, size_t len)
+{
+    auto h = [&](auto&& hasher) {
+        hasher.update(data, len);
+        return hasher.finalize();
+    };
+    switch (algo) {
+    case HashAlgo::Blake3: return h(HasherOf<BLAKE3>());
+    case HashAlgo::Xxh3: return h(HasherOf<XXH3>());
+    default: return h(HasherOf<SHA256>());
+    }
+}
+
+//where one worker's time went during an indexing run, for `bench`; nanoseconds
+//stat: metadata and the previous-index lookup; read: open and read calls, or
+//waiting for io_uring completions; hash: hashing, including the page faults of
+//mapped files, whose reading cannot be told apart from their hashing
+struct PhaseTimes {
+    uint64_t stat = 0;
+    uint64_t read = 0;
+    uint64_t hash = 0;
+    //per file, from its stat to its digest (batched files get an equal share of
+    //their batch's hashing)
+    std::vector<uint64_t> latencies;
+};
+
+//charges the time between successive marks to the phases of a PhaseTimes
+//with no PhaseTimes every call does nothing, so untimed runs pay no clock reads
+class PhaseTimer {
+public:
+    explicit PhaseTimer(PhaseTimes* times) : times_(times) {}
+
+    bool enabled() const { return times_ != nullptr; }
+
+    static uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    //starts timing from now, without charging the time since the last mark
+    void sync() {
+        if (times_) last_ = now();
+    }
+
+    //starts timing a new file
+    void startFile() {
+        if (times_) fileStart_ = last_ = now();
+    }
+
+    //charges the time since the last mark to `phase`, and returns it
+    uint64_t mark(uint64_t PhaseTimes::*phase) {
+        if (!times_) return 0;
+        const uint64_t t = now();
+        const uint64_t d = t - last_;
+        times_->*phase += d;
+        last_ = t;
+        return d;
+    }
+
+    uint64_t fileStart() const { return fileStart_; }
+    uint64_t sinceFileStart() const { return times_ ? now() - fileStart_ : 0; }
+
+    void addLatency(uint64_t ns) {
+        if (times_) times_->latencies.push_back(ns);
+    }
+    //the current file is done
+    void fileDone() { addLatency(sinceFileStart()); }
+
+private:
+    PhaseTimes* times_;
+    uint64_t last_ = 0;
+    uint64_t fileStart_ = 0;
+};
+
+//a file truncated by another process while it is mapped raises SIGBUS on the
+//first access past its new end; hashMapped points this at its jump buffer for
+//the length of the hash, so the fault unwinds to it instead of ending the process
+static thread_local sigjmp_buf* mappedFault = nullptr;
+
+static void onMappedFault(int sig)
+{
+    if (mappedFault) siglongjmp(*mappedFault, 1);
+    //not a mapped read: the default action, as if no handler were installed
+    ::signal(sig, SIG_DFL);
+    ::raise(sig);
+}
+
+//hashes the file in place through a read-only mapping, so large files cost a
+//handful of page faults with kernel readahead instead of millions of read calls
+//returns false when the file cannot be mapped or shrinks while it is hashed;
+//`ctx` may then hold part of the file, and the caller starts over with a new one
+static bool hashMapped(int fd, uint64_t size, Hasher& ctx)
+{
+    if (size == 0 || size > SIZE_MAX) return false;
+    static std::once_flag guard;
+    std::call_once(guard, [] {
+        struct sigaction sa = {};
+        sa.sa_handler = onMappedFault;
+        sigemptyset(&sa.sa_mask);
+        ::sigaction(SIGBUS, &sa, nullptr);
+    });
+    void* base = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) return false;
+    ::madvise(base, size, MADV_SEQUENTIAL);
+    sigjmp_buf jump;
+    volatile bool ok = false;
+    if (sigsetjmp(jump, 1) == 0) {
+        mappedFault = &jump;
+        ctx.update(base, size);
+        ok = true;
+    }
+    mappedFault = nullptr;
+    ::munmap(base, size);
+    return ok;
+}
+
+//reads of ro.readSize (64 KB by default), so BLAKE3 sees enough whole chunks per
+//call to fill its SIMD lanes; the buffer is kept per thread across files
+//a `direct` (O_DIRECT) file is read in whole aligned blocks, and its first short
+//read is its end: a read from the unaligned offset after it would fail
+static bool hashRead(int fd, const ReadOptions& ro, bool direct, Hasher& ctx, PhaseTimer& timer)
+{
+    thread_local IoBuffer buf;
+    size_t len = std::max<size_t>(1, ro.readSize);
+    if (direct) len = (len + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+    buf.resize(len);
+    for (;;) {
+        ssize_t n = ::read(fd, buf.data(), len);
+        timer.mark(&PhaseTimes::read);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return false;
+        if (n == 0) return true;
+        ctx.update(buf.data(), static_cast<size_t>(n));
+        timer.mark(&PhaseTimes::hash);
+        if (direct && static_cast<size_t>(n) < len) return true;
+    }
+}
+
+static bool preadAll(int fd, uint8_t* buf, size_t len, uint64_t offset)
+{
+    while (len > 0) {
+        ssize_t n = ::pread(fd, buf, len, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        buf += n;
+        len -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+//helper threads running for tree-hashed files, across all workers: together they
+//take at most one per core, however many workers start a tree hash at once
+static std::atomic<unsigned> treeHelpers{0};
+
+//claims up to `want` helper threads from the cores left over; how many were claimed
+static unsigned claimTreeHelpers(unsigned want)
+{
+    static const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    unsigned running = treeHelpers.load(std::memory_order_relaxed);
+    for (;;) {
+        const unsigned take = std::min(want, cores > running ? cores - running : 0);
+        if (take == 0 || treeHelpers.compare_exchange_weak(running, running + take)) return take;
+    }
+}
+
+//BLAKE3 of one large file on several threads: the file is cut into 1 MiB
+//segments, each a complete subtree of the hash tree; the threads claim segments
+//in turn and hash them from their own pread buffer, then the calling thread
+//joins the segment chaining values in order and hashes the last segment itself
+//returns false if a segment cannot be read in full (eg: the file shrank), in
+//which case the caller hashes the file the ordinary way
+//segments are aligned, so `fd` may be opened with O_DIRECT (`direct`)
+static bool hashTreeParallel(int fd, uint64_t size, unsigned threads, bool direct, FileDigest& digest)
+{
+    constexpr size_t SEGMENT = 1024 * BLAKE3::CHUNK;
+    //the segment holding the final byte is not a left subtree, it goes through update
+    const uint64_t segments = (size - 1) / SEGMENT;
+    std::vector<BLAKE3::ChainingValue> cvs(segments);
+    std::atomic<uint64_t> next{0};
+    std::atomic<bool> failed{false};
+
+    auto work = [&] {
+        IoBuffer buf(SEGMENT);
+        for (uint64_t s; !failed.load(std::memory_order_relaxed) &&
+                         (s = next.fetch_add(1, std::memory_order_relaxed)) < segments; ) {
+            if (!preadAll(fd, buf.data(), SEGMENT, s * SEGMENT)) {
+                failed = true;
+                return;
+            }
+            cvs[s] = BLAKE3::subtree(buf.data(), SEGMENT, s * (SEGMENT / BLAKE3::CHUNK));
+        }
+    };
+    //helpers run where the calling worker may (eg: its --pin node), not anywhere
+#if defined(__linux__)
+    cpu_set_t affinity;
+    const bool pinned = ::sched_getaffinity(0, sizeof(affinity), &affinity) == 0;
+#endif
+    const unsigned claimed = claimTreeHelpers(static_cast<unsigned>(
+        std::min<uint64_t>(std::max(1u, threads) - 1, segments > 0 ? segments - 1 : 0)));
+    std::vector<std::thread> helpers;
+    for (unsigned t = 0; t < claimed; ++t) {
+        helpers.emplace_back([&] {
+#if defined(__linux__)
+            if (pinned) ::sched_setaffinity(0, sizeof(affinity), &affinity);
+#endif
+            work();
+        });
+    }
+    work();
+    for (auto& t : helpers) t.join();
+    treeHelpers.fetch_sub(claimed);
+    if (failed) return false;
+
+    BLAKE3 h;
+    for (const auto& cv : cvs) h.pushSubtree(cv, SEGMENT / BLAKE3::CHUNK);
+    IoBuffer buf(SEGMENT);
+    for (uint64_t offset = segments * SEGMENT;;) {
+        ssize_t n = ::pread(fd, buf.data(), buf.size(), static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return false;
+        if (n == 0) break;
+        h.update(buf.data(), static_cast<size_t>(n));
+        offset += static_cast<uint64_t>(n);
+        if (direct && static_cast<size_t>(n) < buf.size()) break;
+    }
+    digest = FileDigest(h.finalize());
+    return true;
+}
+
+//hashes one file, mapping it when it is at least ro.mmapThreshold bytes, or
+//splitting it over several threads when BLAKE3 tree hashing applies
+//the size comes from the file itself, not the caller's earlier stat
+//returns an empty digest if the file cannot be opened or read
+//`timer`, if given, is charged with the reading and hashing
+static FileDigest hashFile(const fs::path& p, const ReadOptions& ro, const HashOptions& ho,
+                           PhaseTimer* timer = nullptr)
+{
+    PhaseTimer untimed(nullptr);
+    PhaseTimer& t = timer ? *timer : untimed;
+    bool direct = true;
+    int fd = openForRead(p, ro, direct);
+    if (fd < 0) return FileDigest();
+
+    struct stat st;
+    const uint64_t size = ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) ? st.st_size : 0;
+    t.mark(&PhaseTimes::read);
+    FileDigest digest;
+    if (ho.treeHashes(size) && hashTreeParallel(fd, size, ho.treeThreads, direct, digest)) {
+        closeAfterRead(fd, ro);
+        t.mark(&PhaseTimes::hash);
+        return digest;
+    }
+
+    auto ctx = makeHasher(ho.algo);
+    bool ok = false;
+    //a mapping reads through the page cache, which O_DIRECT is there to avoid
+    if (!direct && ro.mmapThreshold > 0 && size >= ro.mmapThreshold) {
+        ok = hashMapped(fd, size, *ctx);
+        t.mark(&PhaseTimes::hash);
+        //the mapping leaves the file offset at 0, so the read starts over
+        if (!ok) ctx = makeHasher(ho.algo);
+    }
+    if (!ok) ok = hashRead(fd, ro, direct, *ctx, t);
+    closeAfterRead(fd, ro);
+    if (!ok) return FileDigest();
+    digest = ctx->finalize();
+    t.mark(&PhaseTimes::hash);
+    return digest;
+}
+
+//reads all of `s` as a number that is not negative (and, for a floating point
+//one, finite); false for anything else, such as "", "2x", "-1" or one too large
+template <typename T>
+static bool parseNumber(std::string_view s, T& out)
+{
+    T v{};
+    const auto res = std::from_chars(s.data(), s.data() + s.size(), v);
+    if (res.ec != std::errc() || res.ptr != s.data() + s.size() || s[0] == '-') return false;
+    if constexpr (std::is_floating_point_v<T>) {
+        if (!std::isfinite(v)) return false;
+    }
+    out = v;
+    return true;
+}
+
+static constexpr uint32_t UTF8_INVALID = UINT32_MAX;
+
+//the code point of the multi-byte sequence at s[i], advancing i past it
+//UTF8_INVALID (and i unchanged) for overlong forms, surrogates and stray bytes
+static uint32_t decodeUtf8(std::string_view s, size_t& i)
+{
+    const uint8_t c = static_cast<uint8_t>(s[i]);
+    size_t n;
+    uint32_t cp, min;
+    if (c >= 0xc2 && c <= 0xdf) { n = 2; cp = c & 0x1f; min = 0x80; }
+    else if (c >= 0xe0 && c <= 0xef) { n = 3; cp = c & 0x0f; min = 0x800; }
+    else if (c >= 0xf0 && c <= 0xf4) { n = 4; cp = c & 0x07; min = 0x10000; }
+    else return UTF8_INVALID;
+    if (s.size() - i < n) return UTF8_INVALID;
+    for (size_t k = 1; k < n; ++k) {
+        const uint8_t cc = static_cast<uint8_t>(s[i + k]);
+        if ((cc & 0xc0) != 0x80) return UTF8_INVALID;
+        cp = cp << 6 | (cc & 0x3f);
+    }
+    if (cp < min || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff)) return UTF8_INVALID;
+    i += n;
+    return cp;
+}
+
+//a JSON string as json.dumps writes it (ensure_ascii): everything outside
+//printable ASCII is a \u escape, and bytes that are not valid UTF-8 are the
+//lone surrogates Python decodes file names to
+static void appendJsonString(std::string& out, std::string_view s)
+{
+    auto escape = [&out](uint32_t unit) {
+        static const char digits[] = "0123456789abcdef";
+        char u[6] = {'\\', 'u', digits[unit >> 12], digits[(unit >> 8) & 0xf],
+                     digits[(unit >> 4) & 0xf], digits[unit & 0xf]};
+        out.append(u, sizeof(u));
+    };
+    out += '"';
+    for (size_t i = 0; i < s.size(); ) {
+        const uint8_t c = static_cast<uint8_t>(s[i]);
+        if (c >= 0x20 && c < 0x7f) {
+            if (c == '"' || c == '\\') out += '\\';
+            out += static_cast<char>(c);
+            ++i;
+            continue;
+        }
+        if (c < 0x80) {
+            switch (c) {
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default: escape(c);
+            }
+            ++i;
+            continue;
+        }
+        const uint32_t cp = decodeUtf8(s, i);
+        if (cp == UTF8_INVALID) {
+            escape(0xdc00 + c);
+            ++i;
+        }
+        else if (cp >= 0x10000) {
+            escape(0xd800 + ((cp - 0x10000) >> 10));
+            escape(0xdc00 + ((cp - 0x10000) & 0x3ff));
+        }
+        else {
+            escape(cp);
+        }
+    }
+    out += '"';
+}
+
+static void writeU32(std::ostream& out, uint32_t v) { out.write(reinterpret_cast<const char*>(&v), sizeof(v)); }
+static void writeU64(std::ostream& out, uint64_t v) { out.write(reinterpret_cast<const char*>(&v), sizeof(v)); }
+static void writeStr(std::ostream& out, std::string_view s)
+{
+    writeU32(out, static_cast<uint32_t>(s.size()));
+    out.write(s.data(), s.size());
+}
+
+//the longest path an index or journal may hold; a file with a longer one is corrupt
+//also keeps every filename length within a Record's 16-bit nameLen
+static constexpr size_t INDEX_PATH_MAX = UINT16_MAX;
+
+//minimal bounds-checked reader over the loaded index bytes
+class IndexReader {
+public:
+    IndexReader(const char* data, size_t len) : p_(data), end_(data + len) {}
+
+    const char* pos() const { return p_; }
+
+    bool bytes(void* dst, size_t n) {
+        if (static_cast<size_t>(end_ - p_) < n) return false;
+        std::memcpy(dst, p_, n);
+        p_ += n;
+        return true;
+    }
+    bool u8(uint8_t& v) { return bytes(&v, sizeof(v)); }
+    bool u32(uint32_t& v) { return bytes(&v, sizeof(v)); }
+    bool u64(uint64_t& v) { return bytes(&v, sizeof(v)); }
+    bool str(std::string& s) {
+        std::string_view v;
+        if (!str(v)) return false;
+        s.assign(v);
+        return true;
+    }
+    //a view into the loaded bytes, valid as long as they are
+    bool str(std::string_view& s) {
+        uint32_t n;
+        if (!u32(n) || static_cast<size_t>(end_ - p_) < n) return false;
+        s = std::string_view(p_, n);
+        p_ += n;
+        return true;
+    }
+    //a path: a string of at most INDEX_PATH_MAX bytes
+    bool path(std::string_view& s) { return str(s) && s.size() <= INDEX_PATH_MAX; }
+
+private:
+    const char* p_;
+    const char* end_;
+};
+
+//the file clock's time of the Unix epoch; the two epochs are a whole number of
+//seconds apart, so rounding the measured difference makes it exact
+static std::chrono::nanoseconds fileClockUnixEpoch()
+{
+    using namespace std::chrono;
+    static const nanoseconds epoch = [] {
+        const auto diff = duration_cast<nanoseconds>(fs::file_time_type::clock::now().time_since_epoch()) -
+                          duration_cast<nanoseconds>(system_clock::now().time_since_epoch());
+        return duration_cast<nanoseconds>(round<seconds>(diff));
+    }();
+    return epoch;
+}
+
+//a stat's mtime as the file clock count fs::last_write_time would give, which is
+//what records store, without the second stat that last_write_time costs
+static uint64_t statMtime(const struct stat& st)
+{
+    using namespace std::chrono;
+    const nanoseconds unix = seconds(st.st_mtim.tv_sec) + nanoseconds(st.st_mtim.tv_nsec);
+    return static_cast<uint64_t>(
+        duration_cast<fs::file_time_type::duration>(unix + fileClockUnixEpoch()).count());
+}
+
+//writes every buffer in `bufs` to `fd` in gathered writes, retrying partial writes
+static bool writeAll(int fd, const std::vector<std::string>& bufs)
+{
+    std::vector<iovec> iov;
+    for (const auto& b : bufs) {
+        if (!b.empty()) iov.push_back({const_cast<char*>(b.data()), b.size()});
+    }
+    size_t first = 0;
+    while (first < iov.size()) {
+        //callers pass a few dozen buffers at most, well under IOV_MAX
+        ssize_t written = ::writev(fd, iov.data() + first, static_cast<int>(iov.size() - first));
+        if (written < 0 && errno == EINTR) continue;
+        if (written < 0) return false;
+        for (size_t left = static_cast<size_t>(written); left > 0; ) {
+            iovec& v = iov[first];
+            if (left < v.iov_len) {
+                v.iov_base = static_cast<char*>(v.iov_base) + left;
+                v.iov_len -= left;
+                break;
+            }
+            left -= v.iov_len;
+            ++first;
+        }
+    }
+    return true;
+}
+
+//streams records as JSONL in the Python indexer's format while indexing runs,
+//so consumers can read the output before the run ends
+//each worker formats its finished records into a Buffer of its own; full buffers
+//go through a bounded queue to one writer thread, which writes everything queued
+//in a single gathered write. a worker that gets ahead of the disk waits for room
+class JsonlWriter {
+public:
+    //"-" writes to standard output
+    JsonlWriter(const fs::path& file, HashAlgo algo) : algo_(hashAlgoName(algo)) {
+        ownsFd_ = file != "-";
+        fd_ = ownsFd_ ? ::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)
+                      : STDOUT_FILENO;
+        if (fd_ < 0) ownsFd_ = false;
+        else thread_ = std::thread([this] { run(); });
+    }
+
+    ~JsonlWriter() { finish(); }
+
+    JsonlWriter(const JsonlWriter&) = delete;
+    JsonlWriter& operator=(const JsonlWriter&) = delete;
+
+    bool ok() const { return fd_ >= 0; }
+
+    //waits until everything queued is written; false if the file could not be
+    //opened or a write failed. the Buffers must be flushed first
+    bool finish() {
+        if (thread_.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(m_);
+                closing_ = true;
+            }
+            notEmpty_.notify_one();
+            thread_.join();
+        }
+        if (ownsFd_) {
+            ownsFd_ = false;
+            if (::close(fd_) != 0) failed_ = true;
+        }
+        return ok() && !failed_;
+    }
+
+    //one worker's lines; every member does nothing when there is no writer
+    class Buffer {
+    public:
+        explicit Buffer(JsonlWriter* w) : w_(w) {}
+        ~Buffer() { flush(); }
+
+        Buffer(const Buffer&) = delete;
+        Buffer& operator=(const Buffer&) = delete;
+
+        //a stat-ed file: its hash, or an error if the digest is empty, `error`
+        //being the errno of the read that failed
+        void record(const RecordStore& records, const Record& r, uint32_t owner, int error) {
+            if (!w_) return;
+            const std::string_view path = records.path(r);
+            begin(records.filename(r), path);
+            out_ += ", \"size\": ";
+            appendNumber(r.size);
+            out_ += ", \"mtime\": ";
+            appendMtime(r.mtime);
+            out_ += ", \"owner\": ";
+            appendNumber(owner);
+            if (r.digest.len > 0) {
+                static const char digits[] = "0123456789abcdef";
+                out_ += ", \"hash\": \"";
+                for (size_t i = 0; i < r.digest.len; ++i) {
+                    out_ += digits[r.digest.bytes[i] >> 4];
+                    out_ += digits[r.digest.bytes[i] & 0xf];
+                }
+                out_ += '"';
+            }
+            else {
+                appendError(error, path);
+            }
+            end();
+        }
+
+        //a file that could not be stat-ed, so only its name and the error are known
+        void failed(const fs::path& p, int error) {
+            if (!w_) return;
+            begin(p.filename().native(), p.native());
+            appendError(error, p.native());
+            end();
+        }
+
+        //hands the buffered lines to the writer thread
+        void flush() {
+            if (!w_ || out_.empty()) return;
+            w_->push(std::move(out_));
+            out_.clear();
+            out_.reserve(FLUSH_AT + 1024);
+        }
+
+    private:
+        static constexpr size_t FLUSH_AT = 64 * 1024;
+
+        void begin(std::string_view filename, std::string_view path) {
+            out_ += "{\"filename\": ";
+            appendJsonString(out_, filename);
+            out_ += ", \"path\": ";
+            appendJsonString(out_, path);
+            out_ += ", \"hash_algo\": \"";
+            out_ += w_->algo_;
+            out_ += '"';
+        }
+
+        void end() {
+            out_ += ", \"variant\": \"cpp_thread_pool\"}\n";
+            if (out_.size() >= FLUSH_AT) flush();
+        }
+
+        template <typename T>
+        void appendNumber(T v) {
+            char buf[24];
+            out_.append(buf, std::to_chars(buf, buf + sizeof(buf), v).ptr);
+        }
+
+        //as Python's st_mtime: float seconds since the Unix epoch, printed the way
+        //json.dumps prints floats (shortest round trip, always with a fraction)
+        void appendMtime(uint64_t mtime) {
+            using namespace std::chrono;
+            const auto t = fs::file_time_type::duration(static_cast<fs::file_time_type::rep>(mtime));
+            const nanoseconds unix = duration_cast<nanoseconds>(t) - fileClockUnixEpoch();
+            const auto secs = duration_cast<seconds>(unix);
+            const double value = static_cast<double>(secs.count()) +
+                                 static_cast<double>((unix - secs).count()) * 1e-9;
+            char buf[64];
+            char* end = std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::fixed).ptr;
+            out_.append(buf, end);
+            if (std::find(buf, end, '.') == end) out_ += ".0";
+        }
+
+        //Python's str() of the OSError, eg: [Errno 13] Permission denied: 'path'
+        void appendError(int error, std::string_view path) {
+            std::string text;
+            if (error > 0) {
+                text = "[Errno " + std::to_string(error) + "] " + std::strerror(error) + ": '";
+            }
+            else {
+                text = "Could not read file: '";
+            }
+            text.append(path);
+            text += '\'';
+            out_ += ", \"error\": ";
+            appendJsonString(out_, text);
+        }
+
+        JsonlWriter* w_;
+        std::string out_;
+    };
+
+private:
+    //full buffers waiting to be written; at most this many, about 4 MB
+    static constexpr size_t MAX_PENDING = 64;
+
+    void push(std::string&& lines) {
+        std::unique_lock<std::mutex> lock(m_);
+        notFull_.wait(lock, [this] { return pending_.size() < MAX_PENDING; });
+        pending_.push_back(std::move(lines));
+        if (pending_.size() == 1) notEmpty_.notify_one();
+    }
+
+    //writes whatever is queued, until finish() is called and the queue is empty
+    //after a failed write the rest of the output is dropped, so workers never block
+    void run() {
+        std::vector<std::string> bufs;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(m_);
+                notEmpty_.wait(lock, [this] { return !pending_.empty() || closing_; });
+                if (pending_.empty()) return;
+                bufs.assign(std::make_move_iterator(pending_.begin()),
+                            std::make_move_iterator(pending_.end()));
+                pending_.clear();
+            }
+            notFull_.notify_all();
+            if (!failed_ && !writeAll(fd_, bufs)) failed_ = true;
+        }
+    }
+
+    const char* algo_;
+    int fd_ = -1;
+    bool ownsFd_ = false;
+    std::thread thread_;
+    std::mutex m_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+    std::deque<std::string> pending_;
+    bool closing_ = false;
+    //only touched by the writer thread until it is joined
+    bool failed_ = false;
+};
+
+//a journal of finished records, so a long run that is killed can be resumed
+//(--resume) without hashing again what it already hashed. it is appended to
+//while indexing runs: a header (magic, root, hash algorithm name), then blocks,
+//each a u32 payload length, the low half of the payload's XXH3 and the payload:
+//per record, path, size, mtime, digest length (u8) and raw digest
+//workers fill Buffers of their own, handed over when full or `interval` seconds
+//old; one writer thread appends them and fdatasyncs at most every `interval`,
+//so a crash costs at most the last interval's files
+class CheckpointWriter {
+public:
+    //appends after the first `keep` bytes of `file`, the valid part of an
+    //earlier journal (see loadCheckpoint), or starts a new one when `keep` is 0
+    CheckpointWriter(const fs::path& file, const std::string& root, HashAlgo algo, double interval, uint64_t keep)
+        : interval_(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+              std::chrono::duration<double>(interval))) {
+        fd_ = ::open(file.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (keep == 0 ? O_TRUNC : 0), 0644);
+        if (fd_ < 0) return;
+        if (keep > 0) {
+            if (::ftruncate(fd_, static_cast<off_t>(keep)) != 0 || ::lseek(fd_, 0, SEEK_END) < 0) failed_ = true;
+        }
+        else {
+            std::ostringstream header;
+            header.write(MAGIC, sizeof(MAGIC));
+            writeStr(header, root);
+            writeStr(header, hashAlgoName(algo));
+            if (!writeAll(fd_, {header.str()})) failed_ = true;
+        }
+        lastSync_ = std::chrono::steady_clock::now();
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~CheckpointWriter() { finish(); }
+
+    CheckpointWriter(const CheckpointWriter&) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+    bool ok() const { return fd_ >= 0 && !failed_; }
+
+    //waits until every block queued is written and synced; the Buffers must be flushed first
+    bool finish() {
+        if (thread_.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(m_);
+                closing_ = true;
+            }
+            notEmpty_.notify_one();
+            thread_.join();
+        }
+        if (fd_ >= 0) {
+            if (::fdatasync(fd_) != 0 || ::close(fd_) != 0) failed_ = true;
+            fd_ = -1;
+        }
+        return !failed_;
+    }
+
+    static constexpr char MAGIC[8] = {'C','P','P','C','K','P','0','1'};
+
+    //one worker's finished records; every member does nothing when there is no writer
+    class Buffer {
+    public:
+        explicit Buffer(CheckpointWriter* w) : w_(w) {}
+        ~Buffer() { flush(); }
+
+        Buffer(const Buffer&) = delete;
+        Buffer& operator=(const Buffer&) = delete;
+
+        void record(const RecordStore& records, const Record& r) {
+            if (!w_ || r.digest.len == 0) return;
+            if (out_.empty()) {
+                out_.resize(BLOCK_HEADER);
+                started_ = std::chrono::steady_clock::now();
+            }
+            const std::string_view path = records.path(r);
+            put(static_cast<uint32_t>(path.size()));
+            out_.append(path);
+            put(r.size);
+            put(r.mtime);
+            out_ += static_cast<char>(r.digest.len);
+            out_.append(reinterpret_cast<const char*>(r.digest.bytes.data()), r.digest.len);
+            //after a large file the worker is likely to spend a while on the next one
+            //too, and its records should not wait for it; one push costs little then
+            if (out_.size() >= FLUSH_AT || r.size >= FLUSH_AFTER ||
+                std::chrono::steady_clock::now() - started_ >= w_->interval_) {
+                flush();
+            }
+        }
+
+        //hands the block to the writer thread
+        void flush() {
+            if (!w_ || out_.empty()) return;
+            const uint32_t len = static_cast<uint32_t>(out_.size() - BLOCK_HEADER);
+            XXH3 h;
+            h.update(out_.data() + BLOCK_HEADER, len);
+            const uint32_t check = static_cast<uint32_t>(h.finalize());
+            std::memcpy(&out_[0], &len, sizeof(len));
+            std::memcpy(&out_[4], &check, sizeof(check));
+            w_->push(std::move(out_));
+            out_.clear();
+        }
+
+    private:
+        static constexpr size_t FLUSH_AT = 64 * 1024;
+        static constexpr uint64_t FLUSH_AFTER = 1 << 20;
+
+        template <typename T>
+        void put(T v) { out_.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+
+        CheckpointWriter* w_;
+        std::string out_;
+        std::chrono::steady_clock::time_point started_;
+    };
+
+    static constexpr size_t BLOCK_HEADER = 8;
+
+private:
+    static constexpr size_t MAX_PENDING = 64;
+
+    void push(std::string&& block) {
+        std::unique_lock<std::mutex> lock(m_);
+        notFull_.wait(lock, [this] { return pending_.size() < MAX_PENDING; });
+        pending_.push_back(std::move(block));
+        if (pending_.size() == 1) notEmpty_.notify_one();
+    }
+
+    //appends whatever is queued, syncing once an interval has passed since the
+    //last sync; after a failed write the rest is dropped and the journal ends there
+    void run() {
+        std::vector<std::string> bufs;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(m_);
+                notEmpty_.wait(lock, [this] { return !pending_.empty() || closing_; });
+                if (pending_.empty()) return;
+                bufs.assign(std::make_move_iterator(pending_.begin()),
+                            std::make_move_iterator(pending_.end()));
+                pending_.clear();
+            }
+            notFull_.notify_all();
+            if (failed_) continue;
+            if (!writeAll(fd_, bufs)) failed_ = true;
+            const auto now = std::chrono::steady_clock::now();
+            if (now - lastSync_ >= interval_) {
+                if (::fdatasync(fd_) != 0) failed_ = true;
+                lastSync_ = now;
+            }
+        }
+    }
+
+    std::chrono::steady_clock::duration interval_;
+    std::chrono::steady_clock::time_point lastSync_;
+    int fd_ = -1;
+    std::thread thread_;
+    std::mutex m_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+    std::deque<std::string> pending_;
+    bool closing_ = false;
+    //only touched by the writer thread until it is joined
+    bool failed_ = false;
+};
+
+//reads the journal `file` into `records` when it was written for `root` and
+//`algo`; the first block that is cut short or fails its check ends it, and
+//`valid` is set to the bytes before that block, for the next run to append to
+static bool loadCheckpoint(const fs::path& file, const std::string& root, HashAlgo algo,
+                           RecordStore& records, uint64_t& valid)
+{
+    std::ifstream in(file, std::ios::binary | std::ios::ate);
+    if (!in) return false;
+    std::vector<char> data(static_cast<size_t>(in.tellg()));
+    in.seekg(0);
+    if (!in.read(data.data(), data.size())) return false;
+
+    IndexReader rd(data.data(), data.size());
+    char magic[sizeof(CheckpointWriter::MAGIC)];
+    std::string journalRoot, algoName;
+    HashAlgo journalAlgo;
+    if (!rd.bytes(magic, sizeof(magic)) ||
+        std::memcmp(magic, CheckpointWriter::MAGIC, sizeof(magic)) != 0 ||
+        !rd.str(journalRoot) || journalRoot != root || !rd.str(algoName) ||
+        !parseHashAlgo(algoName, journalAlgo) || journalAlgo != algo) {
+        return false;
+    }
+    for (;;) {
+        valid = static_cast<uint64_t>(rd.pos() - data.data());
+        uint32_t len, check;
+        const char* payload = rd.pos() + CheckpointWriter::BLOCK_HEADER;
+        if (!rd.u32(len) || !rd.u32(check) || static_cast<size_t>(data.data() + data.size() - payload) < len) break;
+        XXH3 h;
+        h.update(payload, len);
+        if (static_cast<uint32_t>(h.finalize()) != check) break;
+        IndexReader block(payload, len);
+        while (block.pos() < payload + len) {
+            std::string_view path;
+            uint64_t size, mtime;
+            FileDigest digest;
+            if (!block.path(path) || !block.u64(size) || !block.u64(mtime) || !block.u8(digest.len) ||
+                digest.len > digest.bytes.size() || !block.bytes(digest.bytes.data(), digest.len)) {
+                return true;
+            }
+            records.add(path, size, mtime).digest = digest;
+        }
+        rd = IndexReader(payload + len, static_cast<size_t>(data.data() + data.size() - (payload + len)));
+    }
+    return true;
+}
+
+//live counters of one worker: written only by that worker, read by the monitor
+//thread, so relaxed loads and stores suffice and no update is a locked instruction
+//aligned to a cache line, so workers never write to the same line
+struct alignas(64) WorkerCounters {
+    //errno values counted one by one; anything larger goes in the last slot, and
+    //failures without an errno (eg: out of memory) in slot 0
+    static constexpr size_t ERRNO_SLOTS = 134;
+
+    std::atomic<uint64_t> files{0};
+    std::atomic<uint64_t> bytes{0};
+    //time spent waiting for jobs, which includes listing directories under the parallel scan
+    std::atomic<uint64_t> blockedNs{0};
+    std::array<std::atomic<uint32_t>, ERRNO_SLOTS> errors{};
+
+    template <typename T>
+    static void add(std::atomic<T>& c, T v) {
+        c.store(c.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+    }
+    void error(int e) {
+        add(errors[e > 0 && static_cast<size_t>(e) < ERRNO_SLOTS ? e : e > 0 ? ERRNO_SLOTS - 1 : 0], 1u);
+    }
+};
+
+//live metrics of one indexing run: every worker's counters plus the depth of the
+//job queue, sampled by a monitor thread every `interval` seconds into a stats
+//line on stderr and/or a metrics file in the Prometheus text format (rewritten
+//in place, eg: for node_exporter's textfile collector)
+class RunMetrics {
+public:
+    struct Options {
+        double interval = 5;
+        bool statsLine = false;
+        fs::path file;
+    };
+
+    RunMetrics(int workers, const Options& opt)
+        : workers_(static_cast<size_t>(std::max(1, workers))),
+          counters_(new WorkerCounters[workers_]), opt_(opt) {}
+
+    ~RunMetrics() { stop(); }
+
+    RunMetrics(const RunMetrics&) = delete;
+    RunMetrics& operator=(const RunMetrics&) = delete;
+
+    WorkerCounters& worker(size_t i) { return counters_[i % workers_]; }
+
+    //starts sampling; `depth` reports the jobs queued right now
+    void start(std::function<size_t()> depth) {
+        depth_ = std::move(depth);
+        started_ = last_ = std::chrono::steady_clock::now();
+        stopping_ = false;
+        monitor_ = std::thread([this] {
+            std::unique_lock<std::mutex> lock(m_);
+            const auto every = std::chrono::duration<double>(std::max(0.05, opt_.interval));
+            while (!cv_.wait_for(lock, every, [this] { return stopping_; })) sample(false);
+        });
+    }
+
+    //takes the last sample, once the workers are done
+    void stop() {
+        if (!monitor_.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            stopping_ = true;
+        }
+        cv_.notify_one();
+        monitor_.join();
+        sample(true);
+    }
+
+private:
+    struct Totals {
+        uint64_t files = 0, bytes = 0, blockedNs = 0, errors = 0;
+    };
+
+    Totals totals() const {
+        Totals t;
+        for (size_t i = 0; i < workers_; ++i) {
+            const WorkerCounters& c = counters_[i];
+            t.files += c.files.load(std::memory_order_relaxed);
+            t.bytes += c.bytes.load(std::memory_order_relaxed);
+            t.blockedNs += c.blockedNs.load(std::memory_order_relaxed);
+            for (const auto& e : c.errors) t.errors += e.load(std::memory_order_relaxed);
+        }
+        return t;
+    }
+
+    void sample(bool final) {
+        const auto now = std::chrono::steady_clock::now();
+        const double elapsed = std::chrono::duration<double>(now - started_).count();
+        const double dt = std::max(1e-9, std::chrono::duration<double>(now - last_).count());
+        const Totals t = totals();
+        const size_t depth = final ? 0 : depth_();
+        maxDepth_ = std::max(maxDepth_, depth);
+
+        if (opt_.statsLine) {
+            char line[256];
+            if (final) {
+                std::snprintf(line, sizeof(line),
+                              "[%7.1fs] done: %llu files, %.1f MB (%.1f MB/s), max queue %zu, errors %llu\n",
+                              elapsed, static_cast<unsigned long long>(t.files), t.bytes / 1048576.0,
+                              t.bytes / 1048576.0 / std::max(1e-9, elapsed), maxDepth_,
+                              static_cast<unsigned long long>(t.errors));
+            }
+            else {
+                const double blocked = (t.blockedNs - prev_.blockedNs) / 1e9 / dt / workers_;
+                std::snprintf(line, sizeof(line),
+                              "[%7.1fs] %llu files (%.0f/s), %.1f MB (%.1f MB/s), queue %zu, "
+                              "blocked %.0f%%, errors %llu\n",
+                              elapsed, static_cast<unsigned long long>(t.files),
+                              (t.files - prev_.files) / dt, t.bytes / 1048576.0,
+                              (t.bytes - prev_.bytes) / 1048576.0 / dt, depth,
+                              100.0 * std::min(1.0, blocked), static_cast<unsigned long long>(t.errors));
+            }
+            std::cerr << line;
+            if (final) printBreakdown();
+        }
+        if (!opt_.file.empty()) writeFile(elapsed, depth);
+        prev_ = t;
+        last_ = now;
+    }
+
+    //the end-of-run details behind the stats line: each worker, then each error
+    void printBreakdown() const {
+        for (size_t i = 0; i < workers_; ++i) {
+            const WorkerCounters& c = counters_[i];
+            std::cerr << "  worker " << i << ": " << c.files.load() << " files, "
+                      << std::fixed << std::setprecision(1) << c.bytes.load() / 1048576.0
+                      << " MB, blocked " << std::setprecision(2) << c.blockedNs.load() / 1e9 << " s\n";
+        }
+        for (size_t e = 0; e < WorkerCounters::ERRNO_SLOTS; ++e) {
+            uint64_t n = 0;
+            for (size_t i = 0; i < workers_; ++i) n += counters_[i].errors[e].load();
+            if (n > 0) std::cerr << "  errors: " << n << " x " << errorName(e) << "\n";
+        }
+    }
+
+    static std::string errorReason(size_t e) {
+        if (e == 0) return "no errno";
+        if (e == WorkerCounters::ERRNO_SLOTS - 1) return "other errno";
+        return std::strerror(static_cast<int>(e));
+    }
+
+    static std::string errorName(size_t e) {
+        if (e == 0 || e == WorkerCounters::ERRNO_SLOTS - 1) return errorReason(e);
+        return "errno " + std::to_string(e) + " (" + errorReason(e) + ")";
+    }
+
+    //the metrics file, written to a temporary file and renamed into place so
+    //readers never see a partial one
+    void writeFile(double elapsed, size_t depth) const {
+        std::string s;
+        auto metric = [&s](const char* name, const char* type, const char* help) {
+            s += "# HELP ";
+            s += name;
+            s += ' ';
+            s += help;
+            s += "\n# TYPE ";
+            s += name;
+            s += ' ';
+            s += type;
+            s += '\n';
+        };
+        auto value = [&s](const std::string& series, double v) {
+            char buf[32];
+            s += series;
+            s += ' ';
+            s.append(buf, std::to_chars(buf, buf + sizeof(buf), v).ptr);
+            s += '\n';
+        };
+        auto perWorker = [&](const char* name, auto get) {
+            for (size_t i = 0; i < workers_; ++i) {
+                value(std::string(name) + "{worker=\"" + std::to_string(i) + "\"}", get(counters_[i]));
+            }
+        };
+
+        metric("cpp_indexer_elapsed_seconds", "gauge", "Time since the run started.");
+        value("cpp_indexer_elapsed_seconds", elapsed);
+        metric("cpp_indexer_queue_depth", "gauge", "Jobs waiting in the queue.");
+        value("cpp_indexer_queue_depth", static_cast<double>(depth));
+        metric("cpp_indexer_files_total", "counter", "Files finished by each worker.");
+        perWorker("cpp_indexer_files_total", [](const WorkerCounters& c) { return double(c.files.load()); });
+        metric("cpp_indexer_bytes_hashed_total", "counter", "Bytes read and hashed by each worker.");
+        perWorker("cpp_indexer_bytes_hashed_total", [](const WorkerCounters& c) { return double(c.bytes.load()); });
+        metric("cpp_indexer_blocked_seconds_total", "counter", "Time each worker waited for jobs.");
+        perWorker("cpp_indexer_blocked_seconds_total",
+                  [](const WorkerCounters& c) { return c.blockedNs.load() / 1e9; });
+        metric("cpp_indexer_errors_total", "counter", "Files that could not be indexed, by errno.");
+        for (size_t e = 0; e < WorkerCounters::ERRNO_SLOTS; ++e) {
+            uint64_t n = 0;
+            for (size_t i = 0; i < workers_; ++i) n += counters_[i].errors[e].load();
+            if (n > 0) {
+                value("cpp_indexer_errors_total{errno=\"" + std::to_string(e) + "\",reason=\"" +
+                          errorReason(e) + "\"}", double(n));
+            }
+        }
+
+        fs::path tmp = opt_.file;
+        tmp += ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::trunc);
+            if (!(out << s)) return;
+        }
+        std::error_code ec;
+        fs::rename(tmp, opt_.file, ec);
+    }
+
+    size_t workers_;
+    std::unique_ptr<WorkerCounters[]> counters_;
+    Options opt_;
+    std::function<size_t()> depth_;
+    std::thread monitor_;
+    std::mutex m_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+    //monitor thread only
+    std::chrono::steady_clock::time_point started_, last_;
+    Totals prev_;
+    size_t maxDepth_ = 0;
+};
+
+//the stat fields of a file that its record does not keep
+struct FileStat {
+    uint32_t owner = 0;
+    uint64_t dev = 0;
+    uint64_t ino = 0;
+    uint64_t nlink = 1;
+};
+
+//digests by inode, so a file reached through several paths (hardlinks, bind
+//mounts, or another root indexed earlier) is read once. an entry is only used
+//while the inode's size and mtime match what was hashed. the table is split into
+//stripes, each with its own lock, so workers rarely contend
+//a run-local cache holds only files with several links; a persisted one
+//(see load/save) holds every file it has seen, across runs and roots
+class InodeCache {
+public:
+    explicit InodeCache(bool everyFile = false) : everyFile_(everyFile) {}
+
+    //whether `st` is worth a lookup and an entry
+    bool covers(const FileStat& st) const { return everyFile_ || st.nlink > 1; }
+
+    bool find(const FileStat& st, uint64_t size, uint64_t mtime, FileDigest& digest) const {
+        const Key k{st.dev, st.ino, size, mtime};
+        const Stripe& s = stripe(k);
+        std::lock_guard<std::mutex> lock(s.m);
+        auto it = s.digests.find(k);
+        if (it == s.digests.end()) return false;
+        digest = it->second;
+        return true;
+    }
+
+    void insert(const FileStat& st, uint64_t size, uint64_t mtime, const FileDigest& digest) {
+        const Key k{st.dev, st.ino, size, mtime};
+        Stripe& s = stripe(k);
+        std::lock_guard<std::mutex> lock(s.m);
+        s.digests[k] = digest;
+    }
+
+    //reads entries saved for `algo`; a missing file, or one of another algorithm, adds nothing
+    bool load(const fs::path& file, HashAlgo algo) {
+        std::ifstream in(file, std::ios::binary | std::ios::ate);
+        if (!in) return false;
+        std::vector<char> data(static_cast<size_t>(in.tellg()));
+        in.seekg(0);
+        if (!in.read(data.data(), data.size())) return false;
+
+        IndexReader rd(data.data(), data.size());
+        char magic[sizeof(MAGIC)];
+        std::string algoName;
+        HashAlgo fileAlgo;
+        uint64_t count;
+        if (!rd.bytes(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(magic)) != 0 ||
+            !rd.str(algoName) || !parseHashAlgo(algoName, fileAlgo) || fileAlgo != algo || !rd.u64(count)) {
+            return false;
+        }
+        for (uint64_t i = 0; i < count; ++i) {
+            Key k;
+            FileDigest d;
+            if (!rd.u64(k.dev) || !rd.u64(k.ino) || !rd.u64(k.size) || !rd.u64(k.mtime) ||
+                !rd.u8(d.len) || d.len > d.bytes.size() || !rd.bytes(d.bytes.data(), d.len)) {
+                return false;
+            }
+            stripe(k).digests[k] = d;
+        }
+        return true;
+    }
+
+    //writes every entry, through a temporary file renamed into place
+    bool save(const fs::path& file, HashAlgo algo) const {
+        fs::path tmp = file;
+        tmp += ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            if (!out) return false;
+            out.write(MAGIC, sizeof(MAGIC));
+            writeStr(out, hashAlgoName(algo));
+            writeU64(out, size());
+            for (const Stripe& s : stripes_) {
+                std::lock_guard<std::mutex> lock(s.m);
+                for (const auto& e : s.digests) {
+                    writeU64(out, e.first.dev);
+                    writeU64(out, e.first.ino);
+                    writeU64(out, e.first.size);
+                    writeU64(out, e.first.mtime);
+                    out.put(static_cast<char>(e.second.len));
+                    out.write(reinterpret_cast<const char*>(e.second.bytes.data()), e.second.len);
+                }
+            }
+            if (!out) return false;
+        }
+        std::error_code ec;
+        fs::rename(tmp, file, ec);
+        return !ec;
+    }
+
+    size_t size() const {
+        size_t n = 0;
+        for (const Stripe& s : stripes_) {
+            std::lock_guard<std::mutex> lock(s.m);
+            n += s.digests.size();
+        }
+        return n;
+    }
+
+private:
+    static constexpr char MAGIC[8] = {'C','P','P','I','N','O','0','1'};
+    static constexpr size_t STRIPES = 64;
+
+    struct Key {
+        uint64_t dev, ino, size, mtime;
+        bool operator==(const Key& o) const {
+            return dev == o.dev && ino == o.ino && size == o.size && mtime == o.mtime;
+        }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& k) const {
+            uint64_t h = k.ino * 0x9e3779b97f4a7c15ULL ^ k.dev;
+            h ^= (k.mtime + k.size) * 0xc2b2ae3d27d4eb4fULL;
+            return static_cast<size_t>(h ^ h >> 29);
+        }
+    };
+    struct alignas(64) Stripe {
+        mutable std::mutex m;
+        std::unordered_map<Key, FileDigest, KeyHash> digests;
+    };
+
+    Stripe& stripe(const Key& k) { return stripes_[KeyHash()(k) % STRIPES]; }
+    const Stripe& stripe(const Key& k) const { return stripes_[KeyHash()(k) % STRIPES]; }
+
+    bool everyFile_;
+    std::array<Stripe, STRIPES> stripes_;
+};
+
+//where a worker's finished files go: the JSONL stream, the checkpoint journal,
+//the live counters and the inode cache, each only when the run has one
+class FileSink {
+public:
+    FileSink(JsonlWriter* jsonl, CheckpointWriter* checkpoint, WorkerCounters* counters, InodeCache* inodes)
+        : out_(jsonl), checkpoint_(checkpoint), counters_(counters), inodes_(inodes) {}
+
+    //a stat-ed file; `read` says whether its contents were read in this run, and
+    //`error` is the errno if that failed
+    void done(const RecordStore& records, const Record& r, const FileStat& st, int error, bool read) {
+        out_.record(records, r, st.owner, error);
+        checkpoint_.record(records, r);
+        if (read && r.digest.len > 0 && inodes_ && inodes_->covers(st)) {
+            inodes_->insert(st, r.size, r.mtime, r.digest);
+        }
+        if (!counters_) return;
+        WorkerCounters::add(counters_->files, uint64_t(1));
+        if (!read) return;
+        if (r.digest.len > 0) WorkerCounters::add(counters_->bytes, r.size);
+        else counters_->error(error);
+    }
+
+    //a file that could not be stat-ed
+    void failed(const fs::path& p, int error) {
+        out_.failed(p, error);
+        if (counters_) counters_->error(error);
+    }
+
+    //a file given up on for another reason, eg: out of memory
+    void dropped() {
+        if (counters_) counters_->error(0);
+    }
+
+    //jobs.pop(p), counting the time it blocks
+    template <typename Jobs>
+    bool pop(Jobs& jobs, fs::path& p) {
+        if (!counters_) return jobs.pop(p);
+        const uint64_t start = PhaseTimer::now();
+        const bool got = jobs.pop(p);
+        WorkerCounters::add(counters_->blockedNs, PhaseTimer::now() - start);
+        return got;
+    }
+
+    void flush() {
+        out_.flush();
+        checkpoint_.flush();
+    }
+
+private:
+    JsonlWriter::Buffer out_;
+    CheckpointWriter::Buffer checkpoint_;
+    WorkerCounters* counters_;
+    InodeCache* inodes_;
+};
+
+//previous index keyed by path, used by incremental runs to find unchanged files
+//the keys point into the previous RecordStore
+using PreviousIndex = std::unordered_map<std::string_view, const Record*>;
+
+//settings shared by every worker for one indexing run
+struct IndexConfig {
+    int workers = 4;
+    //when set, files whose size and mtime match their previous record keep the old hash
+    const PreviousIndex* previous = nullptr;
+    //files up to this size are read whole and hashed in batches (SHA256::hashMany
+    //for SHA-256); 0 hashes every file on its own
+    uint64_t batchLimit = 16 * 1024;
+    ReadOptions read;
+    HashOptions hash;
+    //list directories as tasks on the worker threads instead of on the main thread
+    bool parallelScan = true;
+    //Fifo: files are hashed in traversal order
+    //LargestFirst: the tree is listed up front and files are hashed largest first
+    enum class Schedule { Fifo, LargestFirst };
+    Schedule schedule = Schedule::Fifo;
+    //false only lists the files: records get their metadata and no digest
+    bool hashContents = true;
+    //when set (sorted), only files with one of these names are indexed; the rest
+    //are skipped before they are even stat-ed
+    const std::vector<std::string>* names = nullptr;
+    //when set, every record is streamed to it as soon as its hash is known
+    JsonlWriter* jsonl = nullptr;
+    //when set, every record with a digest is journaled to it, for --resume
+    CheckpointWriter* checkpoint = nullptr;
+    //when set, workers keep live counters in it and a monitor thread reports them
+    RunMetrics* metrics = nullptr;
+    //digests by inode; when unset, indexDirectory keeps a run-local one for hardlinks
+    InodeCache* inodes = nullptr;
+    //false when nothing needs the records after the run (eg: only JSONL is written):
+    //each worker then drops its records every RECORDS_KEPT files, so memory stays
+    //flat however large the tree is
+    bool keepRecords = true;
+    static constexpr size_t RECORDS_KEPT = 4096;
+    //when above 0, files go through a staged pipeline instead: this many threads
+    //stat and read them, and `workers` threads hash them (see indexPipeline)
+    int readers = 0;
+    //the most paths the sequential scan queues ahead of the workers
+    static constexpr size_t JOBS_QUEUED = 64 * 1024;
+    //auto-sized runs (see planWorkers): the pool has `workers` threads and a tuner
+    //keeps between 1 and all of them running, starting with this many; 0 runs all
+    int autoStart = 0;
+    //None: threads float; Cores: worker i is pinned to one CPU; Nodes: to every
+    //CPU of one NUMA node. workers are spread over the nodes in turn either way
+    enum class Pin { None, Cores, Nodes };
+    Pin pin = Pin::None;
+
+    //threads for work that is not tuned while it runs, eg: parallelFor
+    int fixedThreads() const { return autoStart > 0 ? autoStart : workers; }
+
+    //sharded runs: only the files whose path below the root hashes (XXH3) to
+    //shard `shard` of `shards`, so every node agrees wherever the tree is mounted
+    uint32_t shard = 0;
+    uint32_t shards = 1;
+    //when not empty, only these directories below the root are listed at all
+    std::vector<fs::path> subtrees;
+    //length of the root as the listed paths begin with it; set by indexDirectory
+    size_t rootLength = 0;
+
+    bool dropsRecords(const RecordStore& records) const {
+        return !keepRecords && records.size() >= RECORDS_KEPT;
+    }
+
+    bool wants(const fs::path& p) const {
+        const std::string_view path = p.native();
+        if (shards > 1) {
+            std::string_view rel = path.substr(std::min(rootLength, path.size()));
+            while (!rel.empty() && rel.front() == '/') rel.remove_prefix(1);
+            XXH3 h;
+            h.update(rel.data(), rel.size());
+            if (h.finalize() % shards != shard) return false;
+        }
+        if (!names) return true;
+        const size_t slash = path.find_last_of('/');
+        return std::binary_search(names->begin(), names->end(),
+                                  slash == std::string_view::npos ? path : path.substr(slash + 1), std::less<>());
+    }
+};
+
+//counters filled in by the workers during one indexing run
+struct IndexStats {
+    std::atomic<uint64_t> hashed{0};
+    std::atomic<uint64_t> reused{0};
+    //files whose inode was already hashed, through another path or run
+    std::atomic<uint64_t> linked{0};
+    //bytes of the files to be read, counted as each is stat-ed; what the worker
+    //tuner measures throughput by
+    std::atomic<uint64_t> bytes{0};
+    //timed runs only: one PhaseTimes per worker, sized by the caller (see bench);
+    //left empty, nothing is timed
+    std::vector<PhaseTimes> phases;
+    //timed runs: time spent listing directories, summed over the threads doing it
+    uint64_t traverseNs = 0;
+};
+
+//appends the whole contents of `p` to `out`, reading until EOF
+//`sizeHint` is the size from stat; the file may have changed since
+static bool appendFileContents(const fs::path& p, const ReadOptions& ro,
+                               std::vector<uint8_t>& out, size_t sizeHint)
+{
+    bool direct = false;
+    int fd = openForRead(p, ro, direct);
+    if (fd < 0) return false;
+
+    const size_t start = out.size();
+    size_t used = start;
+    out.resize(start + sizeHint + 1);
+    for (;;) {
+        if (used == out.size()) out.resize(out.size() * 2);
+        ssize_t n = ::read(fd, out.data() + used, out.size() - used);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            closeAfterRead(fd, ro);
+            out.resize(start);
+            return false;
+        }
+        if (n == 0) break;
+        used += static_cast<size_t>(n);
+    }
+    closeAfterRead(fd, ro);
+    out.resize(used);
+    return true;
+}
+
+//small files collected by one worker: each is read whole into one reusable
+//buffer, and the batch is hashed together once full, several files per SIMD pass
+//this avoids the per-file open, chunk buffer and hasher set-up of hashFile
+class SmallFileBatch {
+public:
+    static constexpr size_t MAX_FILES = 64;
+
+    SmallFileBatch(HashAlgo algo, const ReadOptions& ro) : algo_(algo), ro_(ro) {}
+
+    //reads the file of record `index` in `records`, whose size is `size` and
+    //whose stat is `st`
+    void add(size_t index, const fs::path& p, uint64_t size, const FileStat& st, PhaseTimer& timer) {
+        File f{index, data_.size(), st, 0, 0};
+        if (!appendFileContents(p, ro_, data_, size)) {
+            f.start = UNREADABLE;
+            f.error = errno;
+        }
+        timer.mark(&PhaseTimes::read);
+        f.ns = timer.sinceFileStart();
+        files_.push_back(f);
+    }
+
+    bool empty() const { return files_.empty(); }
+    bool full() const { return files_.size() >= MAX_FILES; }
+
+    //hashes every file in the batch, sets the digests of their records and
+    //passes the records on to `out`
+    void flush(RecordStore& records, FileSink& out, PhaseTimer& timer) {
+        if (files_.empty()) return;
+
+        std::vector<SHA256::Message> msgs;
+        std::vector<size_t> readable;
+        for (size_t i = 0; i < files_.size(); ++i) {
+            if (files_[i].start == UNREADABLE) continue;
+            const size_t end = nextStart(i);
+            msgs.push_back({data_.data() + files_[i].start, end - files_[i].start});
+            readable.push_back(files_[i].index);
+        }
+        if (algo_ == HashAlgo::Sha256) {
+            std::vector<SHA256::Digest> digests(msgs.size());
+            SHA256::hashMany(msgs.data(), msgs.size(), digests.data());
+            for (size_t j = 0; j < readable.size(); ++j) {
+                records[readable[j]].digest = FileDigest(digests[j]);
+            }
+        }
+        else {
+            for (size_t j = 0; j < readable.size(); ++j) {
+                records[readable[j]].digest = hashBuffer(algo_, msgs[j].data, msgs[j].len);
+            }
+        }
+        const uint64_t share = readable.empty() ? 0 : timer.mark(&PhaseTimes::hash) / readable.size();
+        for (const File& f : files_) {
+            timer.addLatency(f.ns + (f.start == UNREADABLE ? 0 : share));
+            out.done(records, records[f.index], f.st, f.error, true);
+        }
+
+        files_.clear();
+        data_.clear();
+    }
+
+private:
+    static constexpr size_t UNREADABLE = SIZE_MAX;
+
+    struct File {
+        size_t index;
+        //offset of its bytes in data_, or UNREADABLE with the errno in `error`
+        size_t start;
+        FileStat st;
+        int error;
+        //time spent on it before the batch is hashed
+        uint64_t ns;
+    };
+
+    //end of file i's bytes: the start of the next readable file, or the end of the data
+    size_t nextStart(size_t i) const {
+        for (size_t j = i + 1; j < files_.size(); ++j) {
+            if (files_[j].start != UNREADABLE) return files_[j].start;
+        }
+        return data_.size();
+    }
+
+    HashAlgo algo_;
+    const ReadOptions& ro_;
+    std::vector<File> files_;
+    std::vector<uint8_t> data_;
+};
+
+//appends the record of file `p` to `records`, with its metadata and no digest
+//yet, and sets `fst` to the rest of the file's stat
+//if the file is unchanged since the previous index, or its inode was already
+//hashed, it also reuses that hash and returns true: the file does not need to
+//be read at all
+//throws fs::filesystem_error if the file cannot be stat-ed; nothing is appended then
+static bool prepareRecord(const fs::path& p, const IndexConfig& cfg,
+                          IndexStats& stats, RecordStore& records, FileStat& fst)
+{
+    struct stat st;
+    if (::stat(p.c_str(), &st) != 0) {
+        throw fs::filesystem_error("cannot stat", p, std::error_code(errno, std::generic_category()));
+    }
+    fst.owner = st.st_uid;
+    fst.dev = st.st_dev;
+    fst.ino = st.st_ino;
+    fst.nlink = st.st_nlink;
+    Record& r = records.add(p.native(), static_cast<uint64_t>(st.st_size), statMtime(st));
+
+    const Record* prev = nullptr;
+    if (cfg.previous) {
+        auto it = cfg.previous->find(p.native());
+        if (it != cfg.previous->end()) prev = it->second;
+    }
+    if (prev && prev->size == r.size && prev->mtime == r.mtime) {
+        r.digest = prev->digest;
+        stats.reused.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    if (cfg.hashContents && cfg.inodes && cfg.inodes->covers(fst) &&
+        cfg.inodes->find(fst, r.size, r.mtime, r.digest)) {
+        stats.linked.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    stats.hashed.fetch_add(1, std::memory_order_relaxed);
+    stats.bytes.fetch_add(r.size, std::memory_order_relaxed);
+    return false;
+}
+
+//this method is executed by each thread
+//it repeatedly takes jobs from the shared queue and processes them until no work remains
+//it defines how each file is indexed and how the results are stored safely for variant A
+//`jobs` is the shared JobQueue, or this thread's view of the TaskScheduler
+//results go to this worker's own records, so no lock is needed
+template <typename Jobs>
+static void worker(Jobs& jobs,
+                   RecordStore& records,
+                   const IndexConfig& cfg,
+                   IndexStats& stats,
+                   PhaseTimes* times,
+                   WorkerCounters* counters)
+{
+    fs::path p;
+    FileSink out(cfg.jsonl, cfg.checkpoint, counters, cfg.inodes);
+    PhaseTimer timer(times);
+    SmallFileBatch batch(cfg.hash.algo, cfg.read);
+    //processes jobs until the queue is empty and marked done
+    while (out.pop(jobs, p)) {
+        if (!cfg.wants(p)) continue;
+        if (cfg.dropsRecords(records) && batch.empty()) records.clear();
+        timer.startFile();
+        try {
+            //performs indexing for one file (CPU-bound work) eg: reading metadata and computing SHA-256 hash
+            //unchanged files since the previous index keep their hash without being read
+            FileStat st;
+            const bool reused = prepareRecord(p, cfg, stats, records, st);
+            timer.mark(&PhaseTimes::stat);
+            const size_t i = records.size() - 1;
+            if (reused || !cfg.hashContents) {
+                timer.fileDone();
+                out.done(records, records[i], st, 0, false);
+                continue;
+            }
+            if (records[i].size <= cfg.batchLimit) {
+                //small file: hashed later together with the rest of the batch
+                batch.add(i, p, records[i].size, st, timer);
+                if (batch.full()) batch.flush(records, out, timer);
+                continue;
+            }
+            records[i].digest = hashFile(p, cfg.read, cfg.hash, &timer);
+            const int error = records[i].digest.len > 0 ? 0 : errno;
+            timer.fileDone();
+            out.done(records, records[i], st, error, true);
+        }
+        catch (const fs::filesystem_error& e) {
+            //the file vanished or cannot be stat-ed: no record, only the error line
+            out.failed(p, e.code().value());
+        }
+        catch (...) {
+            // ignore unreadable files
+            out.dropped();
+        }
+    }
+    timer.sync();
+    batch.flush(records, out, timer);
+}
+
+#if defined(INDEXER_URING)
+//a minimal io_uring instance driven through the raw system calls, so no liburing
+//is needed; each worker owns one ring, so submission and completion need no locks
+class Uring {
+public:
+    explicit Uring(unsigned entries) {
+        io_uring_params params{};
+        fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if (fd_ < 0) return;
+
+        sqLen_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqLen_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sqLen_ = cqLen_ = std::max(sqLen_, cqLen_);
+        sqesLen_ = params.sq_entries * sizeof(io_uring_sqe);
+
+        sq_ = ::mmap(nullptr, sqLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     fd_, IORING_OFF_SQ_RING);
+        cq_ = single ? sq_ : ::mmap(nullptr, cqLen_, PROT_READ | PROT_WRITE,
+                                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        void* sqes = ::mmap(nullptr, sqesLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            fd_, IORING_OFF_SQES);
+        if (sq_ == MAP_FAILED || cq_ == MAP_FAILED || sqes == MAP_FAILED) {
+            if (sqes != MAP_FAILED) ::munmap(sqes, sqesLen_);
+            release();
+            return;
+        }
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        char* sq = static_cast<char*>(sq_);
+        sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        char* cq = static_cast<char*>(cq_);
+        cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    ~Uring() {
+        if (sqes_) ::munmap(sqes_, sqesLen_);
+        release();
+    }
+
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+
+    bool ok() const { return fd_ >= 0; }
+
+    //pins the buffers so reads can use IORING_OP_READ_FIXED
+    //false if the kernel refuses, eg: RLIMIT_MEMLOCK is too low
+    bool registerBuffers(const iovec* iov, unsigned n) {
+        return ::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS, iov, n) == 0;
+    }
+
+    //queues a read of `len` bytes at `offset`; `fixedIndex` >= 0 names the registered
+    //buffer `buf` belongs to. `tag` comes back with the completion
+    void queueRead(int fd, void* buf, unsigned len, uint64_t offset, int fixedIndex, uint64_t tag) {
+        const unsigned tail = *sqTail_;
+        const unsigned idx = tail & sqMask_;
+        io_uring_sqe& sqe = sqes_[idx];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = fixedIndex >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uint64_t>(buf);
+        sqe.len = len;
+        sqe.off = offset;
+        if (fixedIndex >= 0) sqe.buf_index = static_cast<uint16_t>(fixedIndex);
+        sqe.user_data = tag;
+        sqArray_[idx] = idx;
+        __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+        ++queued_;
+    }
+
+    //submits the queued reads and waits until at least one read has completed
+    bool submitAndWait() {
+        for (;;) {
+            long n = ::syscall(__NR_io_uring_enter, fd_, queued_, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (n >= 0) {
+                queued_ -= static_cast<unsigned>(n);
+                return true;
+            }
+            if (errno != EINTR) return false;
+        }
+    }
+
+    //reads queued but not yet handed to the kernel
+    unsigned unsubmitted() const { return queued_; }
+
+    //waits for and discards `n` completions without submitting anything, so the
+    //buffers of the reads in flight can be released; false if the ring fails first
+    bool drain(unsigned n) {
+        for (;;) {
+            unsigned got = 0;
+            reap([&](uint64_t, int) { ++got; });
+            n -= std::min(n, got);
+            if (n == 0) return true;
+            if (::syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+                errno != EINTR) {
+                return false;
+            }
+        }
+    }
+
+    //calls fn(tag, result) for every completion that has arrived
+    template <typename Fn>
+    void reap(Fn&& fn) {
+        unsigned head = *cqHead_;
+        const unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes_[head & cqMask_];
+            fn(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    }
+
+private:
+    void release() {
+        if (cq_ && cq_ != MAP_FAILED && cq_ != sq_) ::munmap(cq_, cqLen_);
+        if (sq_ && sq_ != MAP_FAILED) ::munmap(sq_, sqLen_);
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+    }
+
+    int fd_ = -1;
+    void* sq_ = nullptr;
+    void* cq_ = nullptr;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqLen_ = 0, cqLen_ = 0, sqesLen_ = 0;
+    unsigned* sqTail_ = nullptr;
+    unsigned* sqArray_ = nullptr;
+    unsigned sqMask_ = 0;
+    unsigned* cqHead_ = nullptr;
+    unsigned* cqTail_ = nullptr;
+    unsigned cqMask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned queued_ = 0;
+};
+
+//io_uring variant of worker(): rather than blocking in one read at a time, each
+//thread keeps up to uringDepth files open with one read in flight per file and
+//hashes every chunk as its completion arrives, so I/O depth no longer needs threads
+//returns false if io_uring is unavailable (eg: blocked by seccomp) or fails, after
+//finishing any files it had started; the caller then carries on with worker()
+template <typename Jobs>
+static bool uringWorker(Jobs& jobs,
+                        RecordStore& records,
+                        const IndexConfig& cfg,
+                        IndexStats& stats,
+                        PhaseTimes* times,
+                        WorkerCounters* counters)
+{
+    const unsigned depth = std::max(1u, cfg.read.uringDepth);
+    Uring ring(depth);
+    if (!ring.ok()) return false;
+
+    //whole aligned blocks, so the reads also work on files opened with O_DIRECT
+    const size_t chunk = std::max(DIRECT_ALIGN, cfg.read.uringChunk / DIRECT_ALIGN * DIRECT_ALIGN);
+    auto buffers = std::make_unique<IoBuffer>(depth * chunk);
+    std::vector<iovec> iov(depth);
+    for (unsigned i = 0; i < depth; ++i) iov[i] = {buffers->data() + i * chunk, chunk};
+    const bool fixed = ring.registerBuffers(iov.data(), depth);
+
+    //one file being read; slot i always reads into buffer i
+    struct Slot {
+        int fd = -1;
+        uint64_t offset = 0;
+        //the size from fstat, and whether the file was opened with O_DIRECT
+        uint64_t size = 0;
+        bool direct = false;
+        std::unique_ptr<Hasher> ctx;
+        //index of the file's record in `records`, and the rest of the file's stat
+        size_t rec = 0;
+        FileStat st;
+        //timed runs: when the file was started, for its latency
+        uint64_t started = 0;
+    };
+    std::vector<Slot> slots(depth);
+    std::vector<unsigned> freeSlots;
+    for (unsigned i = depth; i > 0; --i) freeSlots.push_back(i - 1);
+
+    FileSink out(cfg.jsonl, cfg.checkpoint, counters, cfg.inodes);
+    PhaseTimer timer(times);
+    //`error` is the errno of a failed read, 0 once the file has been read in full
+    auto finish = [&](unsigned i, int error) {
+        Slot& s = slots[i];
+        closeAfterRead(s.fd, cfg.read);
+        s.fd = -1;
+        if (error == 0) records[s.rec].digest = s.ctx->finalize();
+        timer.mark(&PhaseTimes::hash);
+        if (timer.enabled()) timer.addLatency(PhaseTimer::now() - s.started);
+        out.done(records, records[s.rec], s.st, error, true);
+        freeSlots.push_back(i);
+    };
+    auto readNext = [&](unsigned i) {
+        ring.queueRead(slots[i].fd, iov[i].iov_base, static_cast<unsigned>(chunk),
+                       slots[i].offset, fixed ? static_cast<int>(i) : -1, i);
+    };
+    auto start = [&](const fs::path& p) {
+        if (!cfg.wants(p)) return;
+        timer.startFile();
+        try {
+            FileStat st;
+            const bool reused = prepareRecord(p, cfg, stats, records, st);
+            timer.mark(&PhaseTimes::stat);
+            const size_t rec = records.size() - 1;
+            if (reused || !cfg.hashContents) {
+                timer.fileDone();
+                out.done(records, records[rec], st, 0, false);
+                return;
+            }
+            //a tree-hashed file already keeps every core busy; waiting for it here is fine
+            if (cfg.hash.treeHashes(records[rec].size)) {
+                records[rec].digest = hashFile(p, cfg.read, cfg.hash, &timer);
+                const int error = records[rec].digest.len > 0 ? 0 : errno;
+                timer.fileDone();
+                out.done(records, records[rec], st, error, true);
+                return;
+            }
+            bool direct = true;
+            int fd = openForRead(p, cfg.read, direct);
+            const int error = errno;
+            timer.mark(&PhaseTimes::read);
+            if (fd < 0) {
+                timer.fileDone();
+                out.done(records, records[rec], st, error, true);
+                return;
+            }
+            struct stat fst;
+            const unsigned i = freeSlots.back();
+            freeSlots.pop_back();
+            slots[i].fd = fd;
+            slots[i].offset = 0;
+            slots[i].size = ::fstat(fd, &fst) == 0 ? static_cast<uint64_t>(fst.st_size) : 0;
+            slots[i].direct = direct;
+            slots[i].ctx = makeHasher(cfg.hash.algo);
+            slots[i].rec = rec;
+            slots[i].st = st;
+            slots[i].started = timer.fileStart();
+            readNext(i);
+        }
+        catch (const fs::filesystem_error& e) {
+            out.failed(p, e.code().value());
+        }
+        catch (...) {
+            // ignore unreadable files
+            out.dropped();
+        }
+    };
+
+    fs::path p;
+    bool drained = false;
+    for (;;) {
+        //records are only dropped with nothing in flight; until then no new file starts
+        if (freeSlots.size() == depth && cfg.dropsRecords(records)) records.clear();
+        //tops up the files in flight; only blocks on the queue when nothing is in flight
+        while (!drained && !freeSlots.empty() && !cfg.dropsRecords(records)) {
+            if (freeSlots.size() == depth) {
+                if (out.pop(jobs, p)) start(p);
+                else drained = true;
+                continue;
+            }
+            auto got = jobs.tryPop(p);
+            if (got == TryPop::Job) start(p);
+            else {
+                drained = got == TryPop::Done;
+                break;
+            }
+        }
+        if (freeSlots.size() == depth) {
+            if (drained) return true;
+            continue;
+        }
+
+        timer.sync();
+        const bool waited = ring.submitAndWait();
+        timer.mark(&PhaseTimes::read);
+        if (!waited) {
+            //the ring is unusable: hash whatever is in flight with ordinary reads,
+            //once the reads already submitted have landed in their buffers. if even
+            //that fails, the kernel may still write into them, so they are never freed
+            const unsigned open = depth - static_cast<unsigned>(freeSlots.size());
+            if (!ring.drain(open - std::min(open, ring.unsubmitted()))) buffers.release();
+            for (unsigned i = 0; i < depth; ++i) {
+                if (slots[i].fd < 0) continue;
+                closeAfterRead(slots[i].fd, cfg.read);
+                slots[i].fd = -1;
+                Record& r = records[slots[i].rec];
+                r.digest = hashFile(fs::path(std::string(records.path(r))), cfg.read, cfg.hash, &timer);
+                out.done(records, r, slots[i].st, r.digest.len > 0 ? 0 : errno, true);
+            }
+            return false;
+        }
+        ring.reap([&](uint64_t tag, int res) {
+            const unsigned i = static_cast<unsigned>(tag);
+            if (res == -EINTR || res == -EAGAIN) {
+                readNext(i);
+                return;
+            }
+            if (res < 0) {
+                finish(i, -res);
+                return;
+            }
+            slots[i].ctx->update(iov[i].iov_base, static_cast<size_t>(res));
+            timer.mark(&PhaseTimes::hash);
+            slots[i].offset += static_cast<uint64_t>(res);
+            //the end is a read of 0, as for hashRead; a short read can come before it
+            //(network and FUSE filesystems, interrupted reads), so it only ends the
+            //file once the size from fstat has been read, sparing the extra read.
+            //an O_DIRECT file cannot be read on from the unaligned offset after one
+            const bool shortRead = static_cast<size_t>(res) < chunk;
+            if (res == 0 || (shortRead && (slots[i].direct || slots[i].offset >= slots[i].size))) finish(i, 0);
+            else readNext(i);
+        });
+    }
+}
+#else
+template <typename Jobs>
+static bool uringWorker(Jobs&, RecordStore&,
+                        const IndexConfig&, IndexStats&, PhaseTimes*, WorkerCounters*)
+{
+    return false;
+}
+#endif
+
+//the CPUs this process may run on, grouped by NUMA node as sysfs lists them
+//(one node holding every CPU where there is no NUMA information)
+class CpuLayout {
+public:
+    static const CpuLayout& get() {
+        static const CpuLayout layout;
+        return layout;
+    }
+
+    size_t cpus() const {
+        size_t n = 0;
+        for (const auto& node : nodes_) n += node.size();
+        return n;
+    }
+
+    //pins the calling thread, as worker i, under `pin`; a no-op without support
+    void pin(IndexConfig::Pin pin, size_t i) const {
+#if defined(__linux__)
+        if (pin == IndexConfig::Pin::None || nodes_.empty()) return;
+        const auto& node = nodes_[i % nodes_.size()];
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (pin == IndexConfig::Pin::Cores) CPU_SET(node[(i / nodes_.size()) % node.size()], &set);
+        else for (int cpu : node) CPU_SET(cpu, &set);
+        ::sched_setaffinity(0, sizeof(set), &set);
+#else
+        (void)pin;
+        (void)i;
+#endif
+    }
+
+private:
+    CpuLayout() {
+#if defined(__linux__)
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (::sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+            std::error_code ec;
+            for (int n = 0; fs::exists("/sys/devices/system/node/node" + std::to_string(n), ec); ++n) {
+                std::ifstream in("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist");
+                std::string list;
+                std::vector<int> node;
+                if (std::getline(in, list)) {
+                    for (int cpu : parseCpuList(list)) {
+                        if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) node.push_back(cpu);
+                    }
+                }
+                if (!node.empty()) nodes_.push_back(std::move(node));
+            }
+            if (nodes_.empty()) {
+                std::vector<int> all;
+                for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                    if (CPU_ISSET(cpu, &allowed)) all.push_back(cpu);
+                }
+                if (!all.empty()) nodes_.push_back(std::move(all));
+            }
+        }
+#endif
+        if (nodes_.empty()) {
+            std::vector<int> all(std::max(1u, std::thread::hardware_concurrency()));
+            for (size_t c = 0; c < all.size(); ++c) all[c] = static_cast<int>(c);
+            nodes_.push_back(std::move(all));
+        }
+    }
+
+    //"0-3,8,10-11" as 0 1 2 3 8 10 11
+    static std::vector<int> parseCpuList(const std::string& list) {
+        std::vector<int> cpus;
+        std::istringstream in(list);
+        std::string range;
+        while (std::getline(in, range, ',')) {
+            int first = 0, last = 0;
+            const size_t dash = range.find('-');
+            const std::string_view r(range);
+            if (!parseNumber(r.substr(0, dash), first) ||
+                (dash != std::string::npos && !parseNumber(r.substr(dash + 1), last))) {
+                continue;
+            }
+            if (dash == std::string::npos) last = first;
+            for (int c = first; c <= last; ++c) cpus.push_back(c);
+        }
+        return cpus;
+    }
+
+    std::vector<std::vector<int>> nodes_;
+};
+
+//what the tree to index lives on, as far as choosing a worker count goes
+enum class Storage { Solid, Rotational, Network };
+
+static const char* storageName(Storage s)
+{
+    switch (s) {
+    case Storage::Rotational: return "rotational";
+    case Storage::Network: return "network";
+    default: return "solid";
+    }
+}
+
+//network filesystems by their statfs magic, anything else by whether the block
+//device under it (or the disk of that partition) says it is rotational
+static Storage storageOf(const fs::path& root)
+{
+#if defined(__linux__)
+    struct statfs sfs;
+    if (::statfs(root.c_str(), &sfs) == 0) {
+        switch (static_cast<uint32_t>(sfs.f_type)) {
+        case 0x6969:        //NFS
+        case 0xff534d42:    //CIFS
+        case 0xfe534d42:    //SMB2
+        case 0x517b:        //SMB
+        case 0x65735546:    //FUSE, eg: sshfs, s3fs
+        case 0x00c36400:    //Ceph
+        case 0x01021997:    //9P
+        case 0x0bd00bd0:    //Lustre
+        case 0x47504653:    //GPFS
+            return Storage::Network;
+        }
+    }
+    struct stat st;
+    if (::stat(root.c_str(), &st) == 0) {
+        const std::string dev = "/sys/dev/block/" + std::to_string(major(st.st_dev)) + ":" +
+                                std::to_string(minor(st.st_dev));
+        for (const char* queue : {"/queue/rotational", "/../queue/rotational"}) {
+            std::ifstream in(dev + queue);
+            int rotational;
+            if (in >> rotational) return rotational ? Storage::Rotational : Storage::Solid;
+        }
+    }
+#else
+    (void)root;
+#endif
+    return Storage::Solid;
+}
+
+//auto worker sizing: a pool and a starting count from the usable CPUs and the
+//storage under `root`. solid-state storage is hash-bound, so the run starts
+//with a worker per CPU; a spinning disk starts with two, as more mostly add
+//seeks; network storage is latency-bound and starts with two per CPU. the
+//tuner may then grow each up to its pool size while throughput keeps improving
+struct WorkerPlan {
+    int start;
+    int pool;
+    Storage storage;
+};
+
+static WorkerPlan planWorkers(const fs::path& root)
+{
+    const int cpus = static_cast<int>(std::max<size_t>(1, CpuLayout::get().cpus()));
+    const Storage storage = storageOf(root);
+    switch (storage) {
+    case Storage::Rotational: return {2, std::min(16, std::max(2, cpus)), storage};
+    case Storage::Network: return {2 * cpus, std::min(256, 8 * cpus), storage};
+    default: return {cpus, 2 * cpus, storage};
+    }
+}
+
+//parks the workers numbered `active` and up, so an auto-sized pool can run fewer
+//threads than it has; the tuner moves that limit while indexing runs
+class WorkerGate {
+public:
+    explicit WorkerGate(int active) : active_(active) {}
+
+    bool parked(int i) const { return i >= active_.load(std::memory_order_relaxed); }
+
+    //blocks worker i while it is parked
+    void enter(int i) {
+        if (!parked(i)) return;
+        std::unique_lock<std::mutex> lock(m_);
+        cv_.wait(lock, [&] { return open_ || !parked(i); });
+    }
+
+    int active() const { return active_.load(std::memory_order_relaxed); }
+
+    void setActive(int n) {
+        std::lock_guard<std::mutex> lock(m_);
+        active_.store(n, std::memory_order_relaxed);
+        cv_.notify_all();
+    }
+
+    //the jobs have run out: parked workers go on to find that out for themselves,
+    //finishing any jobs their Consumer batch still holds
+    void open() {
+        std::lock_guard<std::mutex> lock(m_);
+        open_ = true;
+        active_.store(OPEN, std::memory_order_relaxed);
+        cv_.notify_all();
+    }
+
+    //active() once the gate is open
+    static constexpr int OPEN = 1 << 30;
+
+private:
+    std::atomic<int> active_;
+    std::mutex m_;
+    std::condition_variable cv_;
+    bool open_ = false;
+};
+
+//a worker's jobs behind the gate: pop waits while the worker is parked, and
+//tryPop answers Empty, so an io_uring worker finishes its reads in flight first
+template <typename Jobs>
+class GatedJobs {
+public:
+    GatedJobs(Jobs& jobs, WorkerGate& gate, int id) : jobs_(jobs), gate_(gate), id_(id) {}
+
+    bool pop(fs::path& p) {
+        gate_.enter(id_);
+        if (jobs_.pop(p)) return true;
+        gate_.open();
+        return false;
+    }
+
+    TryPop tryPop(fs::path& p) {
+        if (gate_.parked(id_)) return TryPop::Empty;
+        TryPop got = jobs_.tryPop(p);
+        if (got == TryPop::Done) gate_.open();
+        return got;
+    }
+
+private:
+    Jobs& jobs_;
+    WorkerGate& gate_;
+    int id_;
+};
+
+//hill climbing on observed throughput: every INTERVAL_MS the tuner measures
+//the work done, as bytes read plus FILE_COST per file, and while a step up
+//to half again as many workers gains at least 5% it keeps stepping up; the
+//first step that does not is taken back. after SETTLED intervals it probes
+//upwards again, as the tree may have moved on to faster or slower files
+class WorkerTuner {
+public:
+    static constexpr unsigned INTERVAL_MS = 250;
+    static constexpr unsigned SETTLED = 8;
+    static constexpr uint64_t FILE_COST = 64 * 1024;
+
+    WorkerTuner(WorkerGate& gate, int pool, const IndexStats& stats)
+        : gate_(gate), pool_(pool), stats_(stats), thread_([this] { run(); }) {}
+
+    ~WorkerTuner() {
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+private:
+    uint64_t work() const {
+        return stats_.bytes.load(std::memory_order_relaxed) +
+               FILE_COST * (stats_.hashed.load(std::memory_order_relaxed) +
+                            stats_.reused.load(std::memory_order_relaxed) +
+                            stats_.linked.load(std::memory_order_relaxed));
+    }
+
+    void run() {
+        uint64_t last = work();
+        double best = 0;
+        int before = gate_.active();
+        //the first probe comes after two intervals, once the workers are going
+        unsigned settled = SETTLED - 2;
+        bool climbing = false;
+        std::unique_lock<std::mutex> lock(m_);
+        while (!cv_.wait_for(lock, std::chrono::milliseconds(INTERVAL_MS), [&] { return stop_; })) {
+            const uint64_t now = work();
+            const double rate = static_cast<double>(now - last);
+            last = now;
+            const int active = gate_.active();
+            if (active == WorkerGate::OPEN) return; //the run is ending
+            if (climbing && rate < best * 1.05) {
+                //that step did not pay: back to the count before it
+                gate_.setActive(before);
+                climbing = false;
+                settled = 0;
+                continue;
+            }
+            best = std::max(best, rate);
+            if (climbing || ++settled >= SETTLED) {
+                if (!climbing) best = rate;
+                settled = 0;
+                climbing = active < pool_;
+                before = active;
+                if (climbing) gate_.setActive(std::min(pool_, active + std::max(1, active / 2)));
+            }
+        }
+    }
+
+    WorkerGate& gate_;
+    const int pool_;
+    const IndexStats& stats_;
+    std::mutex m_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+//calls onFile(entry) for each regular file in `dir` and below, in the order
+//recursive_directory_iterator lists them, without following directory symlinks
+//a directory that cannot be read, or that vanishes while it is listed, is skipped
+//with whatever was listed of it, so no error escapes while workers are running
+template <typename F>
+static void listFiles(const fs::path& dir, F onFile)
+{
+    std::vector<fs::directory_iterator> open;
+    std::error_code ec;
+    fs::directory_iterator top(dir, fs::directory_options::skip_permission_denied, ec);
+    if (!ec) open.push_back(std::move(top));
+    while (!open.empty()) {
+        fs::directory_iterator& it = open.back();
+        if (it == fs::directory_iterator()) {
+            open.pop_back();
+            continue;
+        }
+        const fs::directory_entry entry = *it;
+        if (it.increment(ec), ec) it = fs::directory_iterator();
+        if (entry.is_directory(ec) && !entry.is_symlink(ec)) {
+            fs::directory_iterator sub(entry.path(), fs::directory_options::skip_permission_denied, ec);
+            if (!ec) open.push_back(std::move(sub));
+        }
+        else if (entry.is_regular_file(ec)) {
+            onFile(entry);
+        }
+    }
+}
+
+//true when `dir` is `parent` or a directory below it, comparing whole components
+static bool withinSubtree(const fs::path& dir, const fs::path& parent)
+{
+    auto d = dir.begin();
+    for (auto p = parent.begin(); p != parent.end(); ++p, ++d) {
+        if (d == dir.end() || *d != *p) return false;
+    }
+    return true;
+}
+
+//the directories an indexing run lists: the root, or the subtrees of a shard
+//that exist below it
+//the subtrees are normalized, and one given twice or lying inside another is
+//listed once, so no file is indexed twice
+static std::vector<fs::path> scanRoots(const fs::path& root, const IndexConfig& cfg)
+{
+    if (cfg.subtrees.empty()) return {root};
+    std::vector<fs::path> subs;
+    for (const auto& sub : cfg.subtrees) {
+        fs::path n = sub.lexically_normal();
+        if (!n.empty() && !n.has_filename()) n = n.parent_path();
+        if (n.empty() || n == ".") return {root};
+        subs.push_back(std::move(n));
+    }
+    std::vector<fs::path> roots;
+    for (size_t k = 0; k < subs.size(); ++k) {
+        const fs::path& sub = subs[k];
+        bool covered = false;
+        for (size_t j = 0; j < subs.size() && !covered; ++j) {
+            //of two equal subtrees the first is kept
+            covered = j != k && withinSubtree(sub, subs[j]) && (sub != subs[j] || j < k);
+        }
+        if (covered) continue;
+        std::error_code ec;
+        fs::path dir = root / sub;
+        if (fs::is_directory(dir, ec)) roots.push_back(std::move(dir));
+        else std::cerr << "Skipping subtree " << sub.string() << ": not a directory under " << root.string() << "\n";
+    }
+    return roots;
+}
+
+//a blocking FIFO of at most `capacity` items between two pipeline stages: push
+//waits while it is full, so no stage runs further ahead of the next than that
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity_(std::max<size_t>(1, capacity)) {}
+
+    void push(T item) {
+        std::unique_lock<std::mutex> lock(m_);
+        notFull_.wait(lock, [&]{ return q_.size() < capacity_; });
+        q_.push_back(std::move(item));
+        notEmpty_.notify_one();
+    }
+
+    //false once the queue is empty and closed
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(m_);
+        notEmpty_.wait(lock, [&]{ return closed_ || !q_.empty(); });
+        if (q_.empty()) return false;
+        item = std::move(q_.front());
+        q_.pop_front();
+        notFull_.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(m_);
+        closed_ = true;
+        notEmpty_.notify_all();
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(m_);
+        return q_.size();
+    }
+
+private:
+    std::deque<T> q_;
+    std::mutex m_;
+    std::condition_variable notFull_;
+    std::condition_variable notEmpty_;
+    size_t capacity_;
+    bool closed_ = false;
+};
+
+//what a reader hands a hasher: one piece of a file's contents, in order
+//the first piece of a file also carries its record and stat; a file that needs
+//no reading (reused digest, or listing only) or that could not be stat-ed or
+//opened is a single piece with no data
+struct PipelinePiece {
+    uint64_t file = 0;
+    bool first = false;
+    bool last = false;
+    //first piece: the record's metadata, and its digest when it was reused
+    std::string path;
+    uint64_t size = 0;
+    uint64_t mtime = 0;
+    FileStat st;
+    FileDigest digest;
+    //false when the contents are not read: the digest above is the record's
+    bool read = true;
+    //first piece only: the file could not be stat-ed, there is no record
+    bool failed = false;
+    //last piece: the errno if opening or reading failed
+    int error = 0;
+    std::vector<uint8_t> data;
+};
+
+//the staged engine (--readers): the calling thread lists the tree into a bounded
+//job queue; cfg.readers threads stat each file and read it in PIECE-byte pieces;
+//cfg.workers threads hash the pieces and emit the records. all pieces of a file
+//go, in order, through one hasher's bounded queue, so however fast the disk or
+//slow the hash, at most hashers x PIECES_QUEUED pieces wait in memory
+//the readers block in read() while the hashers keep the CPUs busy, so slow or
+//remote storage can have many more reads in flight than there are cores
+static constexpr size_t PIPELINE_PIECE = 1 << 20;
+static constexpr size_t PIPELINE_PIECES_QUEUED = 8;
+
+static void pipelineReader(JobQueue& jobs, std::vector<std::unique_ptr<BoundedQueue<PipelinePiece>>>& hashers,
+                           std::atomic<uint64_t>& nextFile, const IndexConfig& cfg, IndexStats& stats)
+{
+    JobQueue::Consumer consumer(jobs);
+    RecordStore scratch;
+    fs::path p;
+    while (consumer.pop(p)) {
+        if (!cfg.wants(p)) continue;
+        PipelinePiece piece;
+        piece.file = nextFile.fetch_add(1, std::memory_order_relaxed);
+        piece.first = piece.last = true;
+        piece.path = p.native();
+        auto& to = *hashers[piece.file % hashers.size()];
+
+        scratch.clear();
+        bool reused;
+        try {
+            reused = prepareRecord(p, cfg, stats, scratch, piece.st);
+        }
+        catch (const fs::filesystem_error& e) {
+            piece.failed = true;
+            piece.error = e.code().value();
+            to.push(std::move(piece));
+            continue;
+        }
+        catch (...) {
+            piece.failed = true;
+            to.push(std::move(piece));
+            continue;
+        }
+        const Record& r = scratch[0];
+        piece.size = r.size;
+        piece.mtime = r.mtime;
+        if (reused || !cfg.hashContents) {
+            piece.digest = r.digest;
+            piece.read = false;
+            to.push(std::move(piece));
+            continue;
+        }
+
+        bool direct = false;
+        int fd = openForRead(p, cfg.read, direct);
+        if (fd < 0) {
+            piece.error = errno;
+            to.push(std::move(piece));
+            continue;
+        }
+        //a piece one byte larger than a small file sees its end in the same read
+        size_t want = static_cast<size_t>(std::min<uint64_t>(r.size + 1, PIPELINE_PIECE));
+        for (;;) {
+            piece.last = false;
+            piece.data.resize(want);
+            size_t used = 0;
+            while (used < want) {
+                ssize_t n = ::read(fd, piece.data.data() + used, want - used);
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0) {
+                    piece.error = errno;
+                    break;
+                }
+                if (n == 0) break;
+                used += static_cast<size_t>(n);
+            }
+            piece.data.resize(used);
+            piece.last = used < want;
+            const uint64_t file = piece.file;
+            const bool last = piece.last;
+            to.push(std::move(piece));
+            if (last) break;
+            piece = PipelinePiece();
+            piece.file = file;
+            want = PIPELINE_PIECE;
+        }
+        closeAfterRead(fd, cfg.read);
+    }
+}
+
+static void pipelineHasher(BoundedQueue<PipelinePiece>& pieces, RecordStore& records,
+                           const IndexConfig& cfg, WorkerCounters* counters)
+{
+    FileSink out(cfg.jsonl, cfg.checkpoint, counters, cfg.inodes);
+    //files whose first piece arrived and whose last has not yet, by file id
+    struct Open {
+        size_t index;
+        FileStat st;
+        std::unique_ptr<Hasher> ctx;
+    };
+    std::unordered_map<uint64_t, Open> open;
+    PipelinePiece piece;
+    for (;;) {
+        bool got;
+        if (counters) {
+            const uint64_t start = PhaseTimer::now();
+            got = pieces.pop(piece);
+            WorkerCounters::add(counters->blockedNs, PhaseTimer::now() - start);
+        }
+        else {
+            got = pieces.pop(piece);
+        }
+        if (!got) break;
+
+        if (piece.failed) {
+            if (piece.error) out.failed(piece.path, piece.error);
+            else out.dropped();
+            continue;
+        }
+        if (piece.first) {
+            if (open.empty() && cfg.dropsRecords(records)) records.clear();
+            Record& r = records.add(piece.path, piece.size, piece.mtime);
+            if (!piece.read) {
+                r.digest = piece.digest;
+                out.done(records, r, piece.st, 0, false);
+                continue;
+            }
+            if (piece.last) {
+                //the whole file in one piece, the common case
+                if (!piece.error) r.digest = hashBuffer(cfg.hash.algo, piece.data.data(), piece.data.size());
+                out.done(records, r, piece.st, piece.error, true);
+                continue;
+            }
+            Open& f = open[piece.file];
+            f.index = records.size() - 1;
+            f.st = piece.st;
+            f.ctx = makeHasher(cfg.hash.algo);
+        }
+        auto it = open.find(piece.file);
+        if (it == open.end()) continue;
+        Open& f = it->second;
+        if (!piece.error) f.ctx->update(piece.data.data(), piece.data.size());
+        if (!piece.last) continue;
+        Record& r = records[f.index];
+        if (!piece.error) r.digest = f.ctx->finalize();
+        out.done(records, r, f.st, piece.error, true);
+        open.erase(it);
+    }
+}
+
+//runs the staged engine over `root`; hasher i appends to perWorker[i]
+static void indexPipeline(const fs::path& root, const IndexConfig& cfg, IndexStats& stats,
+                          std::vector<RecordStore>& perWorker)
+{
+    const size_t hasherCount = perWorker.size();
+    const uint64_t listStart = PhaseTimer::now();
+    JobQueue jobs(static_cast<size_t>(cfg.readers), IndexConfig::JOBS_QUEUED);
+    std::vector<std::unique_ptr<BoundedQueue<PipelinePiece>>> pieces;
+    for (size_t i = 0; i < hasherCount; ++i) {
+        pieces.push_back(std::make_unique<BoundedQueue<PipelinePiece>>(PIPELINE_PIECES_QUEUED));
+    }
+    if (cfg.metrics) cfg.metrics->start([&] {
+        size_t depth = jobs.depth();
+        for (auto& q : pieces) depth += q->size();
+        return depth;
+    });
+
+    std::atomic<uint64_t> nextFile{0};
+    std::vector<std::thread> hashers, readers;
+    for (size_t i = 0; i < hasherCount; ++i) {
+        hashers.emplace_back([&, i] {
+            CpuLayout::get().pin(cfg.pin, i);
+            pipelineHasher(*pieces[i], perWorker[i], cfg, cfg.metrics ? &cfg.metrics->worker(i) : nullptr);
+        });
+    }
+    for (int i = 0; i < cfg.readers; ++i) {
+        readers.emplace_back([&] { pipelineReader(jobs, pieces, nextFile, cfg, stats); });
+    }
+
+    std::vector<JobQueue::Job> batch;
+    for (const auto& dir : scanRoots(root, cfg)) {
+        listFiles(dir, [&](const fs::directory_entry& entry) {
+            batch.push_back({entry.path(), 0});
+            if (batch.size() >= JobQueue::Consumer::BATCH) jobs.push(batch);
+        });
+    }
+    jobs.push(batch);
+    jobs.done();
+    stats.traverseNs = PhaseTimer::now() - listStart;
+
+    //each stage ends once the one before it has: readers when the queue is done,
+    //hashers when every reader has pushed its last piece
+    for (auto& t : readers) t.join();
+    for (auto& q : pieces) q->close();
+    for (auto& t : hashers) t.join();
+    if (cfg.metrics) cfg.metrics->stop();
+}
+
+//this method coordinates the overall indexing process for variant A
+//it sets up the job queue, spawns worker threads, and collects the final results
+static RecordStore indexDirectory(const fs::path& root, const IndexConfig& config,
+                                  IndexStats& stats)
+{
+    //without a cache given, one that lasts this run still reads hardlinked files once
+    InodeCache runInodes;
+    IndexConfig cfg = config;
+    if (!cfg.inodes) cfg.inodes = &runInodes;
+    cfg.rootLength = root.native().size();
+    //the pipeline's hashers are CPU-bound whatever the storage; it is not tuned
+    if (cfg.readers > 0 && cfg.autoStart > 0) {
+        cfg.workers = std::min(cfg.workers, static_cast<int>(CpuLayout::get().cpus()));
+    }
+
+    //every worker appends to its own records, merged once all workers are done
+    std::vector<RecordStore> perWorker(static_cast<size_t>(std::max(1, cfg.workers)));
+
+    //an auto-sized pool starts with some workers parked, see WorkerTuner
+    WorkerGate gate(cfg.autoStart > 0 ? std::min(cfg.autoStart, cfg.workers) : cfg.workers);
+    std::unique_ptr<WorkerTuner> tuner;
+    if (cfg.autoStart > 0 && cfg.autoStart < cfg.workers && cfg.readers == 0) {
+        tuner = std::make_unique<WorkerTuner>(gate, cfg.workers, stats);
+    }
+
+    auto run = [&](auto& queue, size_t i) {
+        //pinned before its buffers are first touched, so they are allocated on its node
+        CpuLayout::get().pin(cfg.pin, i);
+        GatedJobs<std::remove_reference_t<decltype(queue)>> jobs(queue, gate, static_cast<int>(i));
+        RecordStore& records = perWorker[i];
+        PhaseTimes* times = i < stats.phases.size() ? &stats.phases[i] : nullptr;
+        WorkerCounters* counters = cfg.metrics ? &cfg.metrics->worker(i) : nullptr;
+        if (cfg.read.engine == ReadOptions::Engine::Uring) {
+            if (uringWorker(jobs, records, cfg, stats, times, counters)) return;
+            static std::once_flag warned;
+            std::call_once(warned, [] {
+                std::cerr << "io_uring unavailable, using blocking reads\n";
+            });
+        }
+        worker(jobs, records, cfg, stats, times, counters);
+    };
+    const uint64_t listStart = PhaseTimer::now();
+
+    //spawns worker threads
+    std::vector<std::thread> threads;
+    if (cfg.readers > 0) {
+        indexPipeline(root, cfg, stats, perWorker);
+    }
+    else if (cfg.schedule == IndexConfig::Schedule::LargestFirst) {
+        //longest-processing-time-first: list the whole tree, then hand out files
+        //in descending size order, so the biggest files start first and the tail
+        //of the run is made of small files that spread evenly over the workers
+        std::vector<JobQueue::Job> files;
+        for (const auto& dir : scanRoots(root, cfg)) {
+            listFiles(dir, [&](const fs::directory_entry& entry) {
+                std::error_code ec;
+                const uint64_t size = entry.file_size(ec);
+                files.push_back({entry.path(), ec ? 0 : size});
+            });
+        }
+        std::stable_sort(files.begin(), files.end(),
+                         [](const JobQueue::Job& a, const JobQueue::Job& b) { return a.size > b.size; });
+        stats.traverseNs = PhaseTimer::now() - listStart;
+
+        JobQueue jobs(cfg.workers);
+        jobs.push(files);
+        jobs.done();
+        if (cfg.metrics) cfg.metrics->start([&jobs] { return jobs.depth(); });
+        for (int i = 0; i < cfg.workers; ++i) {
+            threads.emplace_back([&, i] {
+                JobQueue::Consumer consumer(jobs);
+                run(consumer, i);
+            });
+        }
+        for (auto& t : threads) t.join(); //waits for workers to finish
+        if (cfg.metrics) cfg.metrics->stop();
+    }
+    else if (cfg.parallelScan) {
+        //the workers list the tree themselves, starting from the root directory
+        TaskScheduler sched(cfg.workers);
+        for (const auto& dir : scanRoots(root, cfg)) sched.pushRoot(dir);
+        if (cfg.metrics) cfg.metrics->start([&sched] { return sched.depth(); });
+        for (int i = 0; i < cfg.workers; ++i) {
+            threads.emplace_back([&, i] {
+                auto jobs = sched.worker(i);
+                run(jobs, i);
+            });
+        }
+        for (auto& t : threads) t.join(); //waits for workers to finish
+        if (cfg.metrics) cfg.metrics->stop();
+        stats.traverseNs = sched.traversalNanos();
+    }
+    else {
+        JobQueue jobs(cfg.workers, IndexConfig::JOBS_QUEUED);
+        if (cfg.metrics) cfg.metrics->start([&jobs] { return jobs.depth(); });
+        for (int i = 0; i < cfg.workers; ++i) {
+            threads.emplace_back([&, i] {
+                JobQueue::Consumer consumer(jobs);
+                run(consumer, i);
+            });
+        }
+
+        //recursively scans the directory and enqueues each file (Job instance) for processing
+        //files deleted since the previous index are simply never enqueued, so they drop out
+        std::vector<JobQueue::Job> batch;
+        for (const auto& dir : scanRoots(root, cfg)) {
+            listFiles(dir, [&](const fs::directory_entry& entry) {
+                batch.push_back({entry.path(), 0});
+                if (batch.size() >= JobQueue::Consumer::BATCH) jobs.push(batch);
+            });
+        }
+
+        jobs.push(batch);
+        jobs.done();
+        stats.traverseNs = PhaseTimer::now() - listStart;
+        for (auto& t : threads) t.join(); //waits for workers to finish
+        if (cfg.metrics) cfg.metrics->stop();
+    }
+
+    //one allocation and one copy per record, instead of a shared vector regrown under
+    //a lock; the path arenas move across as they are
+    size_t total = 0;
+    for (const auto& w : perWorker) total += w.size();
+    RecordStore records;
+    records.reserve(total);
+    for (auto& w : perWorker) records.append(std::move(w));
+
+    //returns all collected records
+    //this enables CLI queries such as `find` and `checksum`
+    return records;
+}
+
+//the persisted index is a binary file, so `find` and `checksum` can answer
+//queries without walking the tree or hashing anything again
+//every version starts with magic, version, root, hash algorithm name and record
+//count (native byte order). version 5, the one written, then stores the records
+//column by column in path order, see ColumnIndex; version 4 is the same without
+//the size sums. older versions are still read:
+//they store per record path, size, mtime, digest length (u8) and raw digest;
+//version 2 stores the hash as a hex string, and version 1 also has no algorithm
+//name, its hashes all being SHA-256
+static const char INDEX_MAGIC[8] = {'C','P','P','I','D','X','0','1'};
+static const uint32_t INDEX_VERSION = 5;
+static const char* DEFAULT_INDEX_FILE = "cpp-indexer-output.idx";
+//how often a checkpoint journal is synced when --resume is given without --checkpoint
+static const double DEFAULT_CHECKPOINT_SECONDS = 30;
+
+//root paths are compared in this form, so `../test_data` and `../test_data/` match
+static std::string normalRoot(const fs::path& root)
+{
+    fs::path p = fs::absolute(root).lexically_normal();
+    if (p.filename().empty()) p = p.parent_path();
+    return p.string();
+}
+
+//the root as spelled at the start of `path`, a file listed under the normalized
+//`root`: the longest leading directory that normalizes to it, so `path` is
+//"<spelled>/<relative path>". false if there is none, eg: for a relative root
+//listed from another working directory
+static bool rootSpelling(std::string_view path, const std::string& root, std::string& spelled)
+{
+    bool found = false;
+    for (size_t slash = path.find('/'); slash != std::string_view::npos; slash = path.find('/', slash + 1)) {
+        const std::string_view dir = path.substr(0, slash);
+        if (dir.empty() ? root == "/" : normalRoot(dir) == root) {
+            spelled = dir;
+            found = true;
+        }
+    }
+    return found;
+}
+
+//rewrites the paths of `records`, listed under some spelling of the normalized
+//`root`, as a run given `to` lists them, so `index ./data/` finds the files of an
+//index built by `index data`. a path whose spelling cannot be told keeps it
+static void respellRoot(RecordStore& records, const std::string& root, const fs::path& to)
+{
+    std::string spelled = to.native();
+    if (!spelled.empty() && spelled.back() == '/') spelled.pop_back();
+    spelled += '/';
+    std::string from, path;
+    if (records.size() == 0 || !rootSpelling(records.path(records[0]), root, from) || from + '/' == spelled) return;
+    from += '/';
+
+    //the spelling rarely changes from one record to the next, so it is only
+    //looked for again when a path does not start with the last one
+    RecordStore respelled;
+    respelled.reserve(records.size());
+    for (const auto& r : records) {
+        const std::string_view p = records.path(r);
+        if ((from.empty() || p.rfind(from, 0) != 0) && rootSpelling(p, root, from)) from += '/';
+        if (!from.empty() && p.rfind(from, 0) == 0) {
+            path = spelled;
+            path += p.substr(from.size());
+        }
+        else {
+            path = p;
+        }
+        respelled.add(path, r.size, r.mtime).digest = r.digest;
+    }
+    records = std::move(respelled);
+}
+
+//LEB128: 7 bits per byte, low bits first, the top bit set on all but the last byte
+static void appendVarint(std::string& out, uint64_t v)
+{
+    for (; v >= 0x80; v >>= 7) out += static_cast<char>(v | 0x80);
+    out += static_cast<char>(v);
+}
+
+static bool readVarint(const char*& p, const char* end, uint64_t& v)
+{
+    v = 0;
+    for (unsigned shift = 0; p < end && shift < 64; shift += 7) {
+        const uint8_t b = static_cast<uint8_t>(*p++);
+        v |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+//the filename key of the name hash column: the low half of its XXH3
+static uint32_t nameHash(std::string_view filename)
+{
+    XXH3 h;
+    h.update(filename.data(), filename.size());
+    return static_cast<uint32_t>(h.finalize());
+}
+
+//vector filters over the fixed-width columns of a mapped index, so a query
+//compares 4 (AVX2) or 2 (NEON) sizes per instruction and reads nothing else
+class ColumnScan {
+public:
+    //appends to `out` the position of every value in [first, last) above `threshold`, in order
+    static void above(const uint64_t* v, size_t first, size_t last, uint64_t threshold, std::vector<uint32_t>& out) {
+        dispatch().above(v, first, last, threshold, out);
+    }
+    //appends to `out` the position of every value in [first, last) equal to `key`, in order
+    static void equal(const uint32_t* v, size_t first, size_t last, uint32_t key, std::vector<uint32_t>& out) {
+        dispatch().equal(v, first, last, key, out);
+    }
+
+private:
+    struct Impl {
+        void (*above)(const uint64_t*, size_t, size_t, uint64_t, std::vector<uint32_t>&);
+        void (*equal)(const uint32_t*, size_t, size_t, uint32_t, std::vector<uint32_t>&);
+    };
+
+    static void abovePortable(const uint64_t* v, size_t i, size_t n, uint64_t t, std::vector<uint32_t>& out) {
+        for (; i < n; ++i) {
+            if (v[i] > t) out.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    static void equalPortable(const uint32_t* v, size_t i, size_t n, uint32_t key, std::vector<uint32_t>& out) {
+        for (; i < n; ++i) {
+            if (v[i] == key) out.push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    static void pushMask(unsigned mask, size_t base, std::vector<uint32_t>& out) {
+        for (; mask; mask &= mask - 1) out.push_back(static_cast<uint32_t>(base + __builtin_ctz(mask)));
+    }
+
+#if defined(SHA256_X86)
+    //AVX2 only compares signed 64-bit lanes, so both sides have the sign bit flipped
+    __attribute__((target("avx2")))
+    static void aboveAvx2(const uint64_t* v, size_t i, size_t n, uint64_t t, std::vector<uint32_t>& out) {
+        const __m256i flip = _mm256_set1_epi64x(INT64_MIN);
+        const __m256i th = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(t)), flip);
+        for (; n - i >= 4; i += 4) {
+            const __m256i x = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + i)), flip);
+            pushMask(static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(x, th)))),
+                     i, out);
+        }
+        abovePortable(v, i, n, t, out);
+    }
+
+    __attribute__((target("avx2")))
+    static void equalAvx2(const uint32_t* v, size_t i, size_t n, uint32_t key, std::vector<uint32_t>& out) {
+        const __m256i k = _mm256_set1_epi32(static_cast<int>(key));
+        for (; n - i >= 8; i += 8) {
+            const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + i));
+            pushMask(static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(x, k)))),
+                     i, out);
+        }
+        equalPortable(v, i, n, key, out);
+    }
+#elif defined(SHA256_ARM)
+    static void aboveNeon(const uint64_t* v, size_t i, size_t n, uint64_t t, std::vector<uint32_t>& out) {
+        const uint64x2_t th = vdupq_n_u64(t);
+        for (; n - i >= 2; i += 2) {
+            const uint64x2_t m = vcgtq_u64(vld1q_u64(v + i), th);
+            pushMask(static_cast<unsigned>((vgetq_lane_u64(m, 0) & 1) | (vgetq_lane_u64(m, 1) & 2)), i, out);
+        }
+        abovePortable(v, i, n, t, out);
+    }
+
+    static void equalNeon(const uint32_t* v, size_t i, size_t n, uint32_t key, std::vector<uint32_t>& out) {
+        const uint32x4_t k = vdupq_n_u32(key);
+        for (; n - i >= 4; i += 4) {
+            if (vmaxvq_u32(vceqq_u32(vld1q_u32(v + i), k))) equalPortable(v, i, i + 4, key, out);
+        }
+        equalPortable(v, i, n, key, out);
+    }
+#endif
+
+    static const Impl& dispatch() {
+        static const Impl impl = [] {
+#if defined(SHA256_X86)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) return Impl{aboveAvx2, equalAvx2};
+            return Impl{abovePortable, equalPortable};
+#elif defined(SHA256_ARM)
+            return Impl{aboveNeon, equalNeon};
+#else
+            return Impl{abovePortable, equalPortable};
+#endif
+        }();
+        return impl;
+    }
+};
+
+//a version 4 or 5 index over its bytes (loaded or mapped), reading each column in place
+//after the common header come the digest width (u32) and a reserved u32, then, at
+//the next 64-byte boundary, the offset of every column and of the end of the
+//file. each column starts on a 64-byte boundary:
+//  sizes        u64 per file
+//  name hashes  u32 per file, nameHash() of the filename, for checksum lookups
+//  digests      `width` bytes per file (the algorithm's digest length), zeros when unhashed
+//  hashed       one bit per file, set when it has a digest
+//  mtimes       varint zigzag deltas, each from the previous file's mtime
+//  path blocks  u64 per PATH_BLOCK paths: where the block starts in the path column
+//  size sums    u64 per file and one more: the total size of the files before it,
+//               so the bytes under a directory are two reads (version 5 only)
+//  paths        sorted and front-coded: varint length shared with the previous
+//               path, varint suffix length, suffix; the first of a block shares nothing
+class ColumnIndex {
+public:
+    static constexpr size_t PATH_BLOCK = 16;
+    static constexpr size_t ALIGN = 64;
+    enum Column { Sizes, NameHashes, Digests, Hashed, Mtimes, PathBlocks, SizeSums, Paths, COLUMNS };
+
+    //false unless `data` holds a whole, consistent version 4 or 5 index
+    bool parse(const char* data, size_t len) {
+        IndexReader rd(data, len);
+        char magic[sizeof(INDEX_MAGIC)];
+        uint32_t version, reserved;
+        std::string algoName;
+        if (!rd.bytes(magic, sizeof(magic)) || std::memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0 ||
+            !rd.u32(version) || version < 4 || version > 5 || !rd.str(root_) || !rd.str(algoName) ||
+            !parseHashAlgo(algoName, algo_) || !rd.u64(count_) || !rd.u32(width_) || !rd.u32(reserved) ||
+            width_ > FileDigest().bytes.size() || count_ > UINT32_MAX) {
+            return false;
+        }
+        //version 4 has no size sums column: it is read as an empty one
+        const size_t columns = version == 4 ? COLUMNS - 1 : COLUMNS;
+        const size_t table = alignUp(static_cast<size_t>(rd.pos() - data));
+        if (len < table + (columns + 1) * sizeof(uint64_t)) return false;
+        uint64_t offsets[COLUMNS + 1];
+        std::memcpy(offsets, data + table, (columns + 1) * sizeof(uint64_t));
+        if (version == 4) {
+            std::memmove(offsets + SizeSums + 1, offsets + SizeSums, (COLUMNS - SizeSums) * sizeof(uint64_t));
+        }
+        for (size_t c = 0; c <= COLUMNS; ++c) {
+            if (offsets[c] > len || (c > 0 && offsets[c] < offsets[c - 1]) ||
+                (c < COLUMNS && offsets[c] % ALIGN != 0)) {
+                return false;
+            }
+            col_[c] = data + offsets[c];
+        }
+        return columnBytes(Sizes) >= count_ * 8 && columnBytes(NameHashes) >= count_ * 4 &&
+               columnBytes(Digests) >= count_ * width_ && columnBytes(Hashed) >= (count_ + 63) / 64 * 8 &&
+               columnBytes(PathBlocks) >= blocks() * 8 &&
+               (version == 4 || columnBytes(SizeSums) >= (count_ + 1) * 8);
+    }
+
+    const std::string& root() const { return root_; }
+    HashAlgo algo() const { return algo_; }
+    size_t size() const { return static_cast<size_t>(count_); }
+
+    //the columns are 64-byte aligned within a file that is mapped or loaded at an aligned address
+    const uint64_t* sizes() const { return reinterpret_cast<const uint64_t*>(col_[Sizes]); }
+    const uint32_t* nameHashes() const { return reinterpret_cast<const uint32_t*>(col_[NameHashes]); }
+
+    FileDigest digest(size_t i) const {
+        FileDigest d;
+        uint64_t bits;
+        std::memcpy(&bits, col_[Hashed] + i / 64 * 8, sizeof(bits));
+        if (bits >> (i % 64) & 1) {
+            std::memcpy(d.bytes.data(), col_[Digests] + i * width_, width_);
+            d.len = static_cast<uint8_t>(width_);
+        }
+        return d;
+    }
+
+    //the path of file i, decoded from the start of its block; false if the column is corrupt
+    bool path(size_t i, std::string& out) const {
+        PathCursor c(*this, i / PATH_BLOCK);
+        for (size_t k = i / PATH_BLOCK * PATH_BLOCK; k <= i; ++k) {
+            if (!c.next()) return false;
+        }
+        out = c.path();
+        return true;
+    }
+
+    //sets `at` to the first file whose path is not below `key`; false if the column is corrupt
+    //the first path of each block is stored whole, so the blocks are binary searched
+    //on it and only the block before the answer is decoded file by file
+    bool lowerBound(std::string_view key, size_t& at) const {
+        size_t lo = 0, hi = blocks();
+        while (lo < hi) {
+            const size_t mid = lo + (hi - lo) / 2;
+            PathCursor c(*this, mid);
+            if (!c.next()) return false;
+            if (c.path() < key) lo = mid + 1;
+            else hi = mid;
+        }
+        at = 0;
+        if (lo == 0) return true;
+        PathCursor c(*this, lo - 1);
+        for (at = (lo - 1) * PATH_BLOCK; at < std::min(size(), lo * PATH_BLOCK); ++at) {
+            if (!c.next()) return false;
+            if (c.path() >= key) break;
+        }
+        return true;
+    }
+
+    //the files whose path starts with `prefix`, a directory ending in '/', as
+    //[first, last): in path order they are contiguous and end before "<dir>0",
+    //'0' being the byte after '/'
+    bool prefixRange(const std::string& prefix, size_t& first, size_t& last) const {
+        std::string end = prefix;
+        end.back() = '/' + 1;
+        return lowerBound(prefix, first) && lowerBound(end, last);
+    }
+
+    //the total size of files [first, last)
+    uint64_t bytesIn(size_t first, size_t last) const {
+        if (columnBytes(SizeSums) > 0) {
+            uint64_t a, b;
+            std::memcpy(&a, col_[SizeSums] + first * 8, sizeof(a));
+            std::memcpy(&b, col_[SizeSums] + last * 8, sizeof(b));
+            return b - a;
+        }
+        uint64_t bytes = 0;
+        for (size_t i = first; i < last; ++i) bytes += sizes()[i];
+        return bytes;
+    }
+
+    //calls f(i, path) for files [first, last) in order; false if the column is corrupt
+    template <typename F>
+    bool forEach(size_t first, size_t last, F f) const {
+        PathCursor c(*this, first / PATH_BLOCK);
+        for (size_t k = first / PATH_BLOCK * PATH_BLOCK; k < first; ++k) {
+            if (!c.next()) return false;
+        }
+        for (size_t i = first; i < last; ++i) {
+            if (!c.next()) return false;
+            f(i, c.path());
+        }
+        return true;
+    }
+
+    //writes `records` as a version 5 index
+    static bool write(std::ostream& out, const std::string& root, HashAlgo algo, const RecordStore& records) {
+        std::vector<uint32_t> order(records.size());
+        for (size_t i = 0; i < order.size(); ++i) order[i] = static_cast<uint32_t>(i);
+        auto byPath = [&](uint32_t a, uint32_t b) { return records.path(records[a]) < records.path(records[b]); };
+        //merged shards arrive in path order already
+        if (!std::is_sorted(order.begin(), order.end(), byPath)) std::sort(order.begin(), order.end(), byPath);
+        uint32_t width = 0;
+        for (const auto& r : records) width = std::max<uint32_t>(width, r.digest.len);
+
+        //the variable-width columns are built first, so every offset is known up front
+        std::string mtimes, paths;
+        std::vector<uint64_t> blocks;
+        std::string_view prev;
+        uint64_t prevMtime = 0;
+        for (size_t k = 0; k < order.size(); ++k) {
+            const Record& r = records[order[k]];
+            const int64_t delta = static_cast<int64_t>(r.mtime - prevMtime);
+            appendVarint(mtimes, static_cast<uint64_t>(delta) << 1 ^ static_cast<uint64_t>(delta >> 63));
+            prevMtime = r.mtime;
+
+            const std::string_view p = records.path(r);
+            size_t shared = 0;
+            if (k % PATH_BLOCK == 0) {
+                blocks.push_back(paths.size());
+            }
+            else {
+                while (shared < std::min(p.size(), prev.size()) && p[shared] == prev[shared]) ++shared;
+            }
+            appendVarint(paths, shared);
+            appendVarint(paths, p.size() - shared);
+            paths.append(p.substr(shared));
+            prev = p;
+        }
+
+        const size_t n = records.size();
+        const size_t header = sizeof(INDEX_MAGIC) + 4 + 4 + root.size() + 4 +
+                              std::strlen(hashAlgoName(algo)) + 8 + 4 + 4;
+        const uint64_t bytes[COLUMNS] = {n * 8, n * 4, n * width, (n + 63) / 64 * 8, mtimes.size(),
+                                         blocks.size() * 8, (n + 1) * 8, paths.size()};
+        uint64_t offsets[COLUMNS + 1];
+        offsets[0] = alignUp(alignUp(header) + sizeof(offsets));
+        for (size_t c = 0; c < COLUMNS; ++c) {
+            offsets[c + 1] = c + 1 < COLUMNS ? alignUp(offsets[c] + bytes[c]) : offsets[c] + bytes[c];
+        }
+
+        uint64_t pos = 0;
+        auto pad = [&](uint64_t to) {
+            static const char zeros[ALIGN] = {};
+            out.write(zeros, to - pos);
+            pos = to;
+        };
+        out.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+        writeU32(out, INDEX_VERSION);
+        writeStr(out, root);
+        writeStr(out, hashAlgoName(algo));
+        writeU64(out, n);
+        writeU32(out, width);
+        writeU32(out, 0);
+        pos = header;
+        pad(alignUp(header));
+        out.write(reinterpret_cast<const char*>(offsets), sizeof(offsets));
+        pos += sizeof(offsets);
+
+        pad(offsets[Sizes]);
+        for (uint32_t i : order) writeU64(out, records[i].size);
+        pos += n * 8;
+        pad(offsets[NameHashes]);
+        for (uint32_t i : order) writeU32(out, nameHash(records.filename(records[i])));
+        pos += n * 4;
+        pad(offsets[Digests]);
+        for (uint32_t i : order) {
+            const FileDigest& d = records[i].digest;
+            out.write(reinterpret_cast<const char*>(d.bytes.data()), width);
+        }
+        pos += n * width;
+        pad(offsets[Hashed]);
+        for (size_t k = 0; k < n; k += 64) {
+            uint64_t bits = 0;
+            for (size_t j = k; j < std::min(n, k + 64); ++j) {
+                if (records[order[j]].digest.len == width && width > 0) bits |= uint64_t(1) << (j - k);
+            }
+            writeU64(out, bits);
+        }
+        pos += bytes[Hashed];
+        pad(offsets[Mtimes]);
+        out.write(mtimes.data(), mtimes.size());
+        pos += mtimes.size();
+        pad(offsets[PathBlocks]);
+        for (uint64_t b : blocks) writeU64(out, b);
+        pos += blocks.size() * 8;
+        pad(offsets[SizeSums]);
+        uint64_t sum = 0;
+        writeU64(out, sum);
+        for (uint32_t i : order) writeU64(out, sum += records[i].size);
+        pos += (n + 1) * 8;
+        pad(offsets[Paths]);
+        out.write(paths.data(), paths.size());
+        return static_cast<bool>(out);
+    }
+
+private:
+    static size_t alignUp(size_t n) { return (n + ALIGN - 1) / ALIGN * ALIGN; }
+
+    size_t blocks() const { return (size() + PATH_BLOCK - 1) / PATH_BLOCK; }
+    uint64_t columnBytes(Column c) const { return static_cast<uint64_t>(col_[c + 1] - col_[c]); }
+
+    //walks the path column from the start of one block
+    class PathCursor {
+    public:
+        PathCursor(const ColumnIndex& idx, size_t block) : end_(idx.col_[Paths + 1]) {
+            uint64_t start = 0;
+            if (block < idx.blocks()) std::memcpy(&start, idx.col_[PathBlocks] + block * 8, sizeof(start));
+            p_ = start <= static_cast<uint64_t>(end_ - idx.col_[Paths]) ? idx.col_[Paths] + start : end_;
+        }
+
+        bool next() {
+            uint64_t shared, suffix;
+            if (!readVarint(p_, end_, shared) || !readVarint(p_, end_, suffix) ||
+                shared > path_.size() || suffix > static_cast<uint64_t>(end_ - p_) ||
+                shared + suffix > INDEX_PATH_MAX) {
+                return false;
+            }
+            path_.resize(shared);
+            path_.append(p_, suffix);
+            p_ += suffix;
+            return true;
+        }
+
+        const std::string& path() const { return path_; }
+
+    private:
+        const char* p_;
+        const char* end_;
+        std::string path_;
+    };
+
+public:
+    //decodes the files one at a time, in path order, so the whole index never
+    //has to be held as records
+    class Reader {
+    public:
+        explicit Reader(const ColumnIndex& idx) : idx_(idx), paths_(idx, 0), m_(idx.col_[Mtimes]) {}
+
+        //moves to the next file; false at the end or if a column is corrupt
+        bool next() {
+            uint64_t delta;
+            if (i_ >= idx_.size() || !paths_.next() || !readVarint(m_, idx_.col_[Mtimes + 1], delta)) {
+                corrupt_ = i_ < idx_.size();
+                return false;
+            }
+            mtime_ += static_cast<uint64_t>((delta >> 1) ^ (~(delta & 1) + 1));
+            std::memcpy(&size_, idx_.col_[Sizes] + i_ * 8, sizeof(size_));
+            ++i_;
+            return true;
+        }
+
+        bool corrupt() const { return corrupt_; }
+        const std::string& path() const { return paths_.path(); }
+        uint64_t size() const { return size_; }
+        uint64_t mtime() const { return mtime_; }
+        FileDigest digest() const { return idx_.digest(i_ - 1); }
+
+    private:
+        const ColumnIndex& idx_;
+        PathCursor paths_;
+        const char* m_;
+        size_t i_ = 0;
+        uint64_t size_ = 0;
+        uint64_t mtime_ = 0;
+        bool corrupt_ = false;
+    };
+
+    //decodes every file into `records`, in path order
+    bool toRecords(RecordStore& records) const {
+        records = RecordStore();
+        records.reserve(size());
+        Reader files(*this);
+        while (files.next()) records.add(files.path(), files.size(), files.mtime()).digest = files.digest();
+        return !files.corrupt();
+    }
+
+private:
+    std::string root_;
+    HashAlgo algo_ = HashAlgo::Sha256;
+    uint64_t count_ = 0;
+    uint32_t width_ = 0;
+    const char* col_[COLUMNS + 1] = {};
+};
+
+//writes the index to a temporary file first and renames it into place,
+//so an interrupted run never leaves a half-written index behind
+static bool saveIndex(const fs::path& file, const fs::path& root, HashAlgo algo,
+                      const RecordStore& records)
+{
+    fs::path tmp = file;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out || !ColumnIndex::write(out, normalRoot(root), algo, records)) return false;
+    }
+
+    std::error_code ec;
+    fs::rename(tmp, file, ec);
+    return !ec;
+}
+
+//loads a previously saved index, reading the whole file in one go
+//returns false if the file is missing, truncated or not an index file
+static bool loadIndex(const fs::path& file, std::string& root, HashAlgo& algo,
+                      RecordStore& records)
+{
+    std::ifstream in(file, std::ios::binary | std::ios::ate);
+    if (!in) return false;
+    std::vector<char> data(static_cast<size_t>(in.tellg()));
+    in.seekg(0);
+    if (!in.read(data.data(), data.size())) return false;
+
+    IndexReader rd(data.data(), data.size());
+    char magic[sizeof(INDEX_MAGIC)];
+    uint32_t version;
+    std::string algoName = hashAlgoName(HashAlgo::Sha256);
+    uint64_t count;
+    if (!rd.bytes(magic, sizeof(magic)) ||
+        std::memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0 ||
+        !rd.u32(version) || version < 1 || version > INDEX_VERSION ||
+        !rd.str(root) || (version >= 2 && !rd.str(algoName)) ||
+        !parseHashAlgo(algoName, algo) || !rd.u64(count)) {
+        return false;
+    }
+    if (version >= 4) {
+        ColumnIndex columns;
+        return columns.parse(data.data(), data.size()) && columns.toRecords(records);
+    }
+
+    records = RecordStore();
+    records.reserve(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        std::string_view path;
+        uint64_t size, mtime;
+        FileDigest digest;
+        if (!rd.path(path) || !rd.u64(size) || !rd.u64(mtime)) return false;
+        if (version >= 3) {
+            if (!rd.u8(digest.len) || digest.len > digest.bytes.size() ||
+                !rd.bytes(digest.bytes.data(), digest.len)) {
+                return false;
+            }
+        }
+        else {
+            std::string hex;
+            if (!rd.str(hex) || !FileDigest::fromHex(hex, digest)) return false;
+        }
+        records.add(path, size, mtime).digest = digest;
+    }
+    return true;
+}
+
+//loads `file` into `records` and keys them by path in `previous` when it indexes
+//`root` with `algo`, so an incremental run can reuse its hashes; false otherwise
+//the paths are respelled to start with `root` as given to this run
+static bool loadPrevious(const fs::path& file, const fs::path& root, HashAlgo algo,
+                         RecordStore& records, PreviousIndex& previous)
+{
+    std::string indexedRoot;
+    HashAlgo indexedAlgo;
+    if (!loadIndex(file, indexedRoot, indexedAlgo, records) ||
+        indexedRoot != normalRoot(root) || indexedAlgo != algo) {
+        return false;
+    }
+    respellRoot(records, indexedRoot, root);
+    previous.reserve(records.size());
+    for (const auto& r : records) previous.emplace(records.path(r), &r);
+    return true;
+}
+
+//filename -> records hash table over a loaded store, so a checksum lookup costs
+//a few probes instead of a scan of every record
+//open addressing with linear probing, at most half full; every file with a given
+//name lands on the same probe run, in record order, so duplicates are all found
+class NameIndex {
+public:
+    explicit NameIndex(const RecordStore& records) : records_(records) {
+        size_t cap = 2;
+        while (cap < records.size() * 2) cap *= 2;
+        slots_.assign(cap, Slot{0, EMPTY});
+        mask_ = cap - 1;
+        for (size_t i = 0; i < records.size(); ++i) {
+            const size_t h = hash(records.filename(records[i]));
+            size_t s = h & mask_;
+            while (slots_[s].record != EMPTY) s = (s + 1) & mask_;
+            slots_[s] = {static_cast<uint32_t>(h), static_cast<uint32_t>(i)};
+        }
+    }
+
+    //calls f(record) for every record named `filename`, in record order
+    template <typename F>
+    void forEach(std::string_view filename, F f) const {
+        const size_t h = hash(filename);
+        for (size_t s = h & mask_; slots_[s].record != EMPTY; s = (s + 1) & mask_) {
+            const Record& r = records_[slots_[s].record];
+            if (slots_[s].tag == static_cast<uint32_t>(h) && records_.filename(r) == filename) f(r);
+        }
+    }
+
+private:
+    //record numbers are 32-bit, which limits one index to 4 billion files
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    //`tag` holds the low hash bits, so most mismatches never touch the path arena
+    struct Slot {
+        uint32_t tag;
+        uint32_t record;
+    };
+
+    static size_t hash(std::string_view name) { return std::hash<std::string_view>()(name); }
+
+    const RecordStore& records_;
+    std::vector<Slot> slots_;
+    size_t mask_ = 0;
+};
+
+//record numbers of a loaded store ordered by size (ties in record order), so the
+//files above a size are one binary search and a contiguous range
+class SizeOrder {
+public:
+    explicit SizeOrder(const RecordStore& records) : order_(records.size()) {
+        for (size_t i = 0; i < order_.size(); ++i) order_[i] = static_cast<uint32_t>(i);
+        std::stable_sort(order_.begin(), order_.end(), [&](uint32_t a, uint32_t b) {
+            return records[a].size < records[b].size;
+        });
+        sizes_.reserve(order_.size());
+        for (uint32_t i : order_) sizes_.push_back(records[i].size);
+    }
+
+    //record numbers of the files larger than `bytes`, smallest first
+    std::pair<const uint32_t*, const uint32_t*> largerThan(uint64_t bytes) const {
+        //the sizes are copied out in sorted order, so the search stays in one array
+        const size_t first = std::upper_bound(sizes_.begin(), sizes_.end(), bytes) - sizes_.begin();
+        return {order_.data() + first, order_.data() + order_.size()};
+    }
+
+private:
+    std::vector<uint32_t> order_;
+    std::vector<uint64_t> sizes_;
+};
+
+//CLI QUERY: find all files larger than a specified size in MB, smallest first
+static void queryFind(const RecordStore& records, uint64_t minMB)
+{
+    uint64_t threshold = minMB * 1024ULL * 1024ULL;
+    const SizeOrder bySize(records);
+    auto range = bySize.largerThan(threshold);
+    for (const uint32_t* i = range.first; i != range.second; ++i) {
+        const Record& r = records[*i];
+        std::cout << records.path(r) << " " << r.size << "\n";
+    }
+}
+
+//CLI QUERY: get the checksum of each specified filename, in the index's hash algorithm
+//a single filename matching a single file prints just the hash; otherwise every
+//match is printed as "<hash>  <path>", so duplicate names can be told apart
+static void queryChecksum(const RecordStore& records,
+                          const std::vector<std::string>& filenames)
+{
+    const NameIndex byName(records);
+    for (const auto& filename : filenames) {
+        std::vector<const Record*> matches;
+        byName.forEach(filename, [&](const Record& r) { matches.push_back(&r); });
+        if (matches.empty()) {
+            std::cout << "File not found";
+            if (filenames.size() > 1) std::cout << ": " << filename;
+            std::cout << "\n";
+        }
+        else if (matches.size() == 1 && filenames.size() == 1) {
+            std::cout << matches[0]->digest.hex() << "\n";
+        }
+        else {
+            for (const Record* r : matches) {
+                std::cout << r->digest.hex() << "  " << records.path(*r) << "\n";
+            }
+        }
+    }
+}
+
+//JSONL indexes, as written by the Python indexer (or `index --jsonl`), are queried
+//in place: the file is mapped, cut into pieces at line boundaries, and each line
+//is scanned only as far as needed to pull out size, filename, path and hash, with
+//string values skipped a SIMD block at a time. nothing is loaded into records, so
+//an index of any size needs little more memory than the query's answer
+
+//a whole file mapped read-only; data() is null if it could not be mapped
+class MappedFile {
+public:
+    explicit MappedFile(const fs::path& file) {
+        int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return;
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* base = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (base != MAP_FAILED) {
+                data_ = static_cast<const char*>(base);
+                size_ = static_cast<size_t>(st.st_size);
+                ::madvise(base, size_, MADV_SEQUENTIAL);
+            }
+        }
+        ::close(fd);
+    }
+
+    ~MappedFile() {
+        if (data_) ::munmap(const_cast<char*>(data_), size_);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    //returns the whole pages of [first, last) to the kernel once they are scanned,
+    //so scanning a huge index does not leave all of it mapped in
+    void release(const char* first, const char* last) const {
+        const uintptr_t page = static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE));
+        const uintptr_t a = (reinterpret_cast<uintptr_t>(first) + page - 1) & ~(page - 1);
+        const uintptr_t b = reinterpret_cast<uintptr_t>(last) & ~(page - 1);
+        if (a < b) ::madvise(reinterpret_cast<void*>(a), b - a, MADV_DONTNEED);
+    }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+//--under and --name: the part of the tree a find, checksum or du query covers
+struct QueryScope {
+    //a directory of the root, relative to it or absolute; empty for the whole tree
+    fs::path under;
+    //a glob (fnmatch) every filename must match; empty for any
+    std::string name;
+
+    bool any() const { return !under.empty() || !name.empty(); }
+
+    //`under` relative to the normalized `root`, "" for the root itself; false if
+    //it lies outside the root
+    bool relative(const std::string& root, std::string& rel) const {
+        fs::path p = under.lexically_normal();
+        if (p.is_absolute()) p = p.lexically_relative(root);
+        rel = p.generic_string();
+        while (!rel.empty() && rel.back() == '/') rel.pop_back();
+        if (rel == ".") rel.clear();
+        return !(under.is_absolute() && p.empty()) && rel != ".." && rel.rfind("../", 0) != 0;
+    }
+
+    bool matches(const std::string& path) const {
+        if (name.empty()) return true;
+        const size_t slash = path.find_last_of('/');
+        return ::fnmatch(name.c_str(), path.c_str() + (slash == std::string::npos ? 0 : slash + 1), 0) == 0;
+    }
+};
+
+//the root as it is spelled at the start of the paths of `idx`, which is how it
+//was given when indexed; false for an empty index, or one whose spelling cannot be told
+static bool indexedRootSpelling(const ColumnIndex& idx, std::string& spelled)
+{
+    std::string first;
+    return idx.size() > 0 && idx.path(0, first) && rootSpelling(first, idx.root(), spelled);
+}
+
+//the output of queryFind for the files [first, last) of `idx` whose names match
+//`scope`; only the size column is scanned and only matching paths are decoded
+//false if the path column is corrupt
+static bool findColumns(const ColumnIndex& idx, size_t first, size_t last, const QueryScope& scope,
+                        uint64_t minMB)
+{
+    std::vector<uint32_t> matches;
+    ColumnScan::above(idx.sizes(), first, last, minMB * 1024ULL * 1024ULL, matches);
+    const uint64_t* sizes = idx.sizes();
+    std::stable_sort(matches.begin(), matches.end(), [sizes](uint32_t a, uint32_t b) { return sizes[a] < sizes[b]; });
+    //printed only once every path has decoded, so a corrupt index prints nothing
+    std::string out, path;
+    for (uint32_t i : matches) {
+        if (!idx.path(i, path)) return false;
+        if (!scope.matches(path)) continue;
+        out += path;
+        out += ' ';
+        out += std::to_string(sizes[i]);
+        out += '\n';
+    }
+    std::cout << out;
+    return true;
+}
+
+//the output of queryChecksum for the files [first, last) of `idx` whose names
+//match `scope`, found by comparing the name hash column and decoding only the
+//paths that match it; with no filenames, "<hash>  <path>" for every such file
+static bool checksumColumns(const ColumnIndex& idx, size_t first, size_t last, const QueryScope& scope,
+                            const std::vector<std::string>& filenames)
+{
+    std::ostringstream out;
+    if (filenames.empty()) {
+        const bool ok = idx.forEach(first, last, [&](size_t i, const std::string& path) {
+            if (scope.matches(path)) out << idx.digest(i).hex() << "  " << path << "\n";
+        });
+        if (ok) std::cout << out.str();
+        return ok;
+    }
+    std::vector<uint32_t> candidates;
+    std::string path;
+    for (const auto& filename : filenames) {
+        candidates.clear();
+        ColumnScan::equal(idx.nameHashes(), first, last, nameHash(filename), candidates);
+        std::vector<std::pair<std::string, FileDigest>> matches;
+        for (uint32_t i : candidates) {
+            if (!idx.path(i, path)) return false;
+            const size_t slash = path.find_last_of('/');
+            if (std::string_view(path).substr(slash == std::string::npos ? 0 : slash + 1) == filename &&
+                scope.matches(path)) {
+                matches.emplace_back(path, idx.digest(i));
+            }
+        }
+        if (matches.empty()) {
+            out << "File not found";
+            if (filenames.size() > 1) out << ": " << filename;
+            out << "\n";
+        }
+        else if (matches.size() == 1 && filenames.size() == 1) {
+            out << matches[0].second.hex() << "\n";
+        }
+        else {
+            for (const auto& m : matches) out << m.second.hex() << "  " << m.first << "\n";
+        }
+    }
+    std::cout << out.str();
+    return true;
+}
+
+//CLI QUERY: "<bytes>\t<files>\t<path>" for every directory directly in `dir`
+//(its files being [first, last) of `idx`, every path starting with "<dir>/"),
+//in path order, then the same for `dir` itself
+//without a glob each subdirectory costs one range lookup and two reads of the size
+//sums however much it holds; with one, every file is visited to match its name,
+//and directories with no match are left out
+static bool duColumns(const ColumnIndex& idx, size_t first, size_t last, const std::string& dir,
+                      const QueryScope& scope)
+{
+    const size_t base = dir.size() + (dir.empty() || dir.back() != '/');
+    //the subdirectory of `dir` that `path` is in, with its '/', or "" for a file directly in `dir`
+    auto childOf = [base](const std::string& path) {
+        const size_t slash = path.find('/', base);
+        return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+    };
+    std::ostringstream out;
+    auto line = [&out](uint64_t bytes, uint64_t files, std::string_view path) {
+        out << bytes << '\t' << files << '\t' << path << '\n';
+    };
+    uint64_t bytes = 0, files = 0;
+    if (scope.name.empty()) {
+        std::string path;
+        for (size_t i = first; i < last;) {
+            if (!idx.path(i, path)) return false;
+            std::string child = childOf(path);
+            if (child.empty()) {
+                ++i;
+                continue;
+            }
+            child.back() = '/' + 1;
+            size_t end;
+            if (!idx.lowerBound(child, end)) return false;
+            child.pop_back();
+            line(idx.bytesIn(i, end), end - i, child);
+            i = end;
+        }
+        bytes = idx.bytesIn(first, last);
+        files = last - first;
+    }
+    else {
+        std::string current;
+        uint64_t childBytes = 0, childFiles = 0;
+        auto flush = [&] {
+            if (childFiles > 0) line(childBytes, childFiles, std::string_view(current).substr(0, current.size() - 1));
+            childBytes = childFiles = 0;
+        };
+        const bool ok = idx.forEach(first, last, [&](size_t i, const std::string& path) {
+            std::string child = childOf(path);
+            if (child != current) {
+                flush();
+                current = std::move(child);
+            }
+            if (!scope.matches(path)) return;
+            bytes += idx.sizes()[i];
+            ++files;
+            if (!current.empty()) {
+                childBytes += idx.sizes()[i];
+                ++childFiles;
+            }
+        });
+        if (!ok) return false;
+        flush();
+    }
+    line(bytes, files, dir);
+    std::cout << out.str();
+    return true;
+}
+
+//CLI QUERY over a mapped columnar index of `root`: the output of queryFind; false
+//if `file` is no such index, so the caller falls back to loading (or building) one
+static bool queryFindMapped(const fs::path& file, const fs::path& root, uint64_t minMB)
+{
+    MappedFile map(file);
+    ColumnIndex idx;
+    if (!map.data() || !idx.parse(map.data(), map.size()) || idx.root() != normalRoot(root)) return false;
+    return findColumns(idx, 0, idx.size(), QueryScope(), minMB);
+}
+
+//CLI QUERY over a mapped columnar index of `root`: the output of queryChecksum
+static bool queryChecksumMapped(const fs::path& file, const fs::path& root,
+                                const std::vector<std::string>& filenames)
+{
+    MappedFile map(file);
+    ColumnIndex idx;
+    if (!map.data() || !idx.parse(map.data(), map.size()) || idx.root() != normalRoot(root)) return false;
+    return checksumColumns(idx, 0, idx.size(), QueryScope(), filenames);
+}
+
+//one shard index being merged: its files in path order, decoded in place from
+//the mapped columns of a version 4 or 5 index, or from the loaded and sorted records
+//of an older one
+class ShardSource {
+public:
+    ShardSource() = default;
+    //the reader points into the columns and the columns into the mapping
+    ShardSource(const ShardSource&) = delete;
+    ShardSource& operator=(const ShardSource&) = delete;
+
+    //false if `file` is not a readable index
+    bool open(const fs::path& file) {
+        map_ = std::make_unique<MappedFile>(file);
+        if (map_->data() && columns_.parse(map_->data(), map_->size())) {
+            root_ = columns_.root();
+            algo_ = columns_.algo();
+            reader_ = std::make_unique<ColumnIndex::Reader>(columns_);
+            return true;
+        }
+        map_.reset();
+        if (!loadIndex(file, root_, algo_, records_)) return false;
+        order_.resize(records_.size());
+        for (size_t i = 0; i < order_.size(); ++i) order_[i] = static_cast<uint32_t>(i);
+        std::sort(order_.begin(), order_.end(), [&](uint32_t a, uint32_t b) {
+            return records_.path(records_[a]) < records_.path(records_[b]);
+        });
+        return true;
+    }
+
+    const std::string& root() const { return root_; }
+    HashAlgo algo() const { return algo_; }
+
+    //moves to the next file; false at the end or, with corrupt(), on a bad column
+    bool next() {
+        if (reader_) {
+            if (!reader_->next()) return false;
+            path_ = reader_->path();
+            size_ = reader_->size();
+            mtime_ = reader_->mtime();
+            digest_ = reader_->digest();
+            return true;
+        }
+        if (pos_ >= order_.size()) return false;
+        const Record& r = records_[order_[pos_++]];
+        path_ = records_.path(r);
+        size_ = r.size;
+        mtime_ = r.mtime;
+        digest_ = r.digest;
+        return true;
+    }
+
+    bool corrupt() const { return reader_ && reader_->corrupt(); }
+    std::string_view path() const { return path_; }
+    uint64_t size() const { return size_; }
+    uint64_t mtime() const { return mtime_; }
+    const FileDigest& digest() const { return digest_; }
+
+private:
+    std::unique_ptr<MappedFile> map_;
+    ColumnIndex columns_;
+    std::unique_ptr<ColumnIndex::Reader> reader_;
+    RecordStore records_;
+    std::vector<uint32_t> order_;
+    size_t pos_ = 0;
+    std::string root_;
+    HashAlgo algo_ = HashAlgo::Sha256;
+    //the current file; the path points into the reader or the records
+    std::string_view path_;
+    uint64_t size_ = 0;
+    uint64_t mtime_ = 0;
+    FileDigest digest_;
+};
+
+//combines shard indexes of one root, all hashed the same way, into the single
+//index `out`: a k-way merge over the shards' sorted paths, through a min-heap of
+//one current file per shard. a path found in several shards (overlapping
+//subtrees, or a shard indexed again) is kept once, with its newest mtime
+static bool mergeShards(const std::vector<std::string>& files, const fs::path& out)
+{
+    std::vector<ShardSource> shards(files.size());
+    for (size_t k = 0; k < files.size(); ++k) {
+        if (!shards[k].open(files[k])) {
+            std::cerr << "Not an index: " << files[k] << "\n";
+            return false;
+        }
+        if (shards[k].root() != shards[0].root() || shards[k].algo() != shards[0].algo()) {
+            std::cerr << files[k] << " indexes " << shards[k].root() << " with "
+                      << hashAlgoName(shards[k].algo()) << ", but " << files[0] << " indexes "
+                      << shards[0].root() << " with " << hashAlgoName(shards[0].algo()) << "\n";
+            return false;
+        }
+    }
+
+    //the heap's top is the shard whose current path sorts first, the lowest
+    //numbered on a tie, so duplicates come out next to each other
+    auto later = [&](size_t a, size_t b) {
+        const int c = shards[a].path().compare(shards[b].path());
+        return c != 0 ? c > 0 : a > b;
+    };
+    std::vector<size_t> heap;
+    for (size_t k = 0; k < shards.size(); ++k) {
+        if (shards[k].next()) heap.push_back(k);
+    }
+    std::make_heap(heap.begin(), heap.end(), later);
+
+    RecordStore records;
+    std::string last;
+    bool corrupt = false;
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        ShardSource& s = shards[heap.back()];
+        if (records.empty() || s.path() != last) {
+            records.add(s.path(), s.size(), s.mtime()).digest = s.digest();
+            last = s.path();
+        }
+        else if (s.mtime() > records[records.size() - 1].mtime) {
+            Record& r = records[records.size() - 1];
+            r.size = s.size();
+            r.mtime = s.mtime();
+            r.digest = s.digest();
+        }
+        if (s.next()) {
+            std::push_heap(heap.begin(), heap.end(), later);
+        }
+        else {
+            corrupt = corrupt || s.corrupt();
+            heap.pop_back();
+        }
+    }
+    if (corrupt) {
+        std::cerr << "A shard index is corrupt\n";
+        return false;
+    }
+    if (!saveIndex(out, shards[0].root(), shards[0].algo(), records)) {
+        std::cerr << "Failed to write " << out.string() << "\n";
+        return false;
+    }
+    std::cout << "Merged " << records.size() << " files from " << files.size() << " shards into "
+              << out.string() << "\n";
+    return true;
+}
+
+//the first '"' or '\\' in [p, end), or end: the only bytes that matter inside a
+//JSON string, found 16 or 32 bytes per step
+class JsonScan {
+public:
+    static const char* quoteOrEscape(const char* p, const char* end) { return dispatch()(p, end); }
+
+private:
+    using Find = const char* (*)(const char*, const char*);
+
+    static const char* findPortable(const char* p, const char* end) {
+        for (; p < end; ++p) {
+            if (*p == '"' || *p == '\\') return p;
+        }
+        return end;
+    }
+
+#if defined(SHA256_X86) && defined(__SSE2__)
+    static const char* findSse2(const char* p, const char* end) {
+        const __m128i quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\');
+        for (; end - p >= 16; p += 16) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                                                            _mm_cmpeq_epi8(v, backslash)));
+            if (mask) return p + __builtin_ctz(mask);
+        }
+        return findPortable(p, end);
+    }
+
+    __attribute__((target("avx2")))
+    static const char* findAvx2(const char* p, const char* end) {
+        const __m256i quote = _mm256_set1_epi8('"'), backslash = _mm256_set1_epi8('\\');
+        for (; end - p >= 32; p += 32) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash))));
+            if (mask) return p + __builtin_ctz(mask);
+        }
+        return findSse2(p, end);
+    }
+#elif defined(SHA256_ARM)
+    static const char* findNeon(const char* p, const char* end) {
+        const uint8x16_t quote = vdupq_n_u8('"'), backslash = vdupq_n_u8('\\');
+        for (; end - p >= 16; p += 16) {
+            const uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+            if (vmaxvq_u8(vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, backslash)))) {
+                return findPortable(p, p + 16);
+            }
+        }
+        return findPortable(p, end);
+    }
+#endif
+
+    static Find dispatch() {
+        static const Find find = [] {
+#if defined(SHA256_X86) && defined(__SSE2__)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) return Find(findAvx2);
+            return Find(findSse2);
+#elif defined(SHA256_ARM)
+            return Find(findNeon);
+#else
+            return Find(findPortable);
+#endif
+        }();
+        return find;
+    }
+};
+
+//the fields of one JSONL line that queries use; the strings are raw JSON string
+//contents, escapes still in place (see unescapeJson)
+struct JsonlRecord {
+    std::string_view filename, path, hash;
+    uint64_t size = 0;
+};
+
+static bool isJsonSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+//the end of the JSON string whose opening quote is at p[-1]: its closing quote,
+//or null if the line ends first
+static const char* jsonStringEnd(const char* p, const char* end)
+{
+    for (;;) {
+        p = JsonScan::quoteOrEscape(p, end);
+        if (p == end) return nullptr;
+        if (*p == '"') return p;
+        p += 2;
+        if (p >= end) return nullptr;
+    }
+}
+
+//parses one line, from p up to at most end, into `r`; fields it does not find
+//keep their defaults. other values are skipped without being looked at further
+//returns the position just after the object's closing brace, or null if the line
+//is not a JSON object of the expected shape
+static const char* parseJsonlLine(const char* p, const char* end, JsonlRecord& r)
+{
+    auto skipSpace = [&] {
+        while (p < end && isJsonSpace(*p)) ++p;
+    };
+    skipSpace();
+    if (p == end || *p != '{') return nullptr;
+    ++p;
+    for (;;) {
+        skipSpace();
+        if (p < end && *p == '}') return p + 1;
+        if (p == end || *p != '"') return nullptr;
+        const char* keyEnd = jsonStringEnd(++p, end);
+        if (!keyEnd) return nullptr;
+        const std::string_view key(p, keyEnd - p);
+        p = keyEnd + 1;
+        skipSpace();
+        if (p == end || *p != ':') return nullptr;
+        ++p;
+        skipSpace();
+        if (p == end) return nullptr;
+
+        if (*p == '"') {
+            const char* valueEnd = jsonStringEnd(++p, end);
+            if (!valueEnd) return nullptr;
+            const std::string_view value(p, valueEnd - p);
+            if (key == "filename") r.filename = value;
+            else if (key == "path") r.path = value;
+            else if (key == "hash") r.hash = value;
+            p = valueEnd + 1;
+        }
+        else if (key == "size") {
+            auto res = std::from_chars(p, end, r.size);
+            if (res.ec != std::errc()) return nullptr;
+            p = res.ptr;
+        }
+        else {
+            //numbers, literals, and nested values (none in the Python output)
+            int depth = 0;
+            for (; p < end; ++p) {
+                if (*p == '"') {
+                    p = jsonStringEnd(p + 1, end);
+                    if (!p) return nullptr;
+                }
+                else if (*p == '{' || *p == '[') ++depth;
+                else if (*p == '}' || *p == ']') {
+                    if (depth == 0) break;
+                    --depth;
+                }
+                else if (*p == ',' && depth == 0) break;
+            }
+        }
+
+        skipSpace();
+        if (p < end && *p == ',') ++p;
+        else if (p < end && *p == '}') return p + 1;
+        else return nullptr;
+    }
+}
+
+//appends the UTF-8 bytes of JSON string contents `raw` to `out`
+//lone surrogates \udc80-\udcff become the single bytes Python's surrogateescape
+//stands them for, so file names that are not valid UTF-8 come back unchanged
+static bool unescapeJson(std::string_view raw, std::string& out)
+{
+    auto hex4 = [&](size_t i, uint32_t& v) {
+        if (i + 4 > raw.size()) return false;
+        v = 0;
+        for (size_t k = i; k < i + 4; ++k) {
+            const char c = raw[k];
+            v <<= 4;
+            if (c >= '0' && c <= '9') v |= c - '0';
+            else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    };
+    auto utf8 = [&](uint32_t cp) {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        }
+        else if (cp < 0x800) {
+            out += static_cast<char>(0xc0 | cp >> 6);
+            out += static_cast<char>(0x80 | (cp & 0x3f));
+        }
+        else if (cp < 0x10000) {
+            out += static_cast<char>(0xe0 | cp >> 12);
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (cp & 0x3f));
+        }
+        else {
+            out += static_cast<char>(0xf0 | cp >> 18);
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (cp & 0x3f));
+        }
+    };
+
+    for (size_t i = 0; i < raw.size(); ) {
+        const size_t esc = raw.find('\\', i);
+        out.append(raw.substr(i, esc - i));
+        if (esc == std::string_view::npos) break;
+        if (esc + 1 >= raw.size()) return false;
+        i = esc + 2;
+        switch (raw[esc + 1]) {
+        case '"': out += '"'; break;
+        case '\\': out += '\\'; break;
+        case '/': out += '/'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+            uint32_t cp, low;
+            if (!hex4(i, cp)) return false;
+            i += 4;
+            if (cp >= 0xd800 && cp < 0xdc00 && i + 1 < raw.size() && raw[i] == '\\' &&
+                raw[i + 1] == 'u' && hex4(i + 2, low) && low >= 0xdc00 && low < 0xe000) {
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                i += 6;
+            }
+            if (cp >= 0xdc80 && cp < 0xdd00) out += static_cast<char>(cp - 0xdc00);
+            else utf8(cp);
+            break;
+        }
+        default: return false;
+        }
+    }
+    return true;
+}
+
+//JSON string contents as text: the raw bytes themselves unless they hold escapes
+static std::string_view jsonText(std::string_view raw, std::string& scratch)
+{
+    if (raw.find('\\') == std::string_view::npos) return raw;
+    scratch.clear();
+    unescapeJson(raw, scratch);
+    return scratch;
+}
+
+//whether the file looks like a JSONL index rather than a binary one
+static bool isJsonlIndex(const fs::path& file)
+{
+    std::ifstream in(file, std::ios::binary);
+    char c;
+    while (in.get(c)) {
+        if (!isJsonSpace(c) && c != '\n') return c == '{';
+    }
+    return false;
+}
+
+//scans the JSONL index on several threads, in pieces of about 64 MB cut at line
+//boundaries: scan(record, result) runs for every line of a piece, filling that
+//piece's Result, and consume(result) then runs on this thread for each piece in
+//file order. workers stay a few pieces ahead of consume, so results for the
+//whole file are never held at once
+template <typename Result, typename Scan, typename Consume>
+static bool scanJsonl(const fs::path& file, Scan scan, Consume consume)
+{
+    MappedFile map(file);
+    if (!map.data()) return false;
+    const char* data = map.data();
+    const size_t len = map.size();
+
+    constexpr size_t PIECE = 64 << 20;
+    std::vector<const char*> bounds{data};
+    for (size_t off = PIECE; off < len; off += PIECE) {
+        const char* from = std::max(bounds.back(), data + off);
+        const void* nl = std::memchr(from, '\n', data + len - from);
+        if (!nl) break;
+        bounds.push_back(static_cast<const char*>(nl) + 1);
+    }
+    bounds.push_back(data + len);
+    const size_t pieces = bounds.size() - 1;
+
+    const unsigned threads = static_cast<unsigned>(std::min<size_t>(
+        std::max(1u, std::thread::hardware_concurrency()), pieces));
+    std::vector<Result> results(pieces);
+    std::vector<char> ready(pieces, 0);
+    size_t consumed = 0;
+    size_t next = 0;
+    std::mutex m;
+    std::condition_variable cv;
+
+    auto work = [&] {
+        for (;;) {
+            size_t piece;
+            {
+                std::unique_lock<std::mutex> lock(m);
+                cv.wait(lock, [&] { return next >= pieces || next < consumed + 2 * threads; });
+                if (next >= pieces) return;
+                piece = next++;
+            }
+            Result result;
+            for (const char* p = bounds[piece]; p < bounds[piece + 1]; ) {
+                const char* lineEnd = static_cast<const char*>(
+                    std::memchr(p, '\n', bounds[piece + 1] - p));
+                if (!lineEnd) lineEnd = bounds[piece + 1];
+                JsonlRecord r;
+                if (parseJsonlLine(p, lineEnd, r)) scan(r, result);
+                p = lineEnd + 1;
+            }
+            map.release(bounds[piece], bounds[piece + 1]);
+            {
+                std::lock_guard<std::mutex> lock(m);
+                results[piece] = std::move(result);
+                ready[piece] = 1;
+            }
+            cv.notify_all();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) workers.emplace_back(work);
+
+    for (size_t piece = 0; piece < pieces; ++piece) {
+        Result result;
+        {
+            std::unique_lock<std::mutex> lock(m);
+            cv.wait(lock, [&] { return ready[piece] != 0; });
+            result = std::move(results[piece]);
+        }
+        consume(result);
+        {
+            std::lock_guard<std::mutex> lock(m);
+            consumed = piece + 1;
+        }
+        cv.notify_all();
+    }
+    for (auto& t : workers) t.join();
+    return true;
+}
+
+//CLI QUERY (JSONL index): as find, in file order like the Python indexer's query
+static bool queryFindJsonl(const fs::path& file, uint64_t minMB)
+{
+    const uint64_t threshold = minMB * 1024ULL * 1024ULL;
+    return scanJsonl<std::string>(file,
+        [&](const JsonlRecord& r, std::string& out) {
+            if (r.size <= threshold) return;
+            std::string scratch;
+            out.append(jsonText(r.path, scratch));
+            out += ' ';
+            char buf[24];
+            out.append(buf, std::to_chars(buf, buf + sizeof(buf), r.size).ptr);
+            out += '\n';
+        },
+        [](const std::string& out) { std::cout.write(out.data(), out.size()); });
+}
+
+//CLI QUERY (JSONL index): as checksum, printing matches as queryChecksum does
+static bool queryChecksumJsonl(const fs::path& file, const std::vector<std::string>& filenames)
+{
+    struct Match {
+        size_t name;
+        std::string hash, path;
+    };
+    std::vector<std::vector<Match>> matches(filenames.size());
+    const bool ok = scanJsonl<std::vector<Match>>(file,
+        [&](const JsonlRecord& r, std::vector<Match>& out) {
+            std::string scratch;
+            const std::string_view name = jsonText(r.filename, scratch);
+            for (size_t i = 0; i < filenames.size(); ++i) {
+                if (name != filenames[i]) continue;
+                std::string path;
+                unescapeJson(r.path, path);
+                //a record with no hash string (eg: an unreadable file's) prints as
+                //Python prints rec.get("hash") for it
+                out.push_back({i, r.hash.data() ? std::string(r.hash) : std::string("None"), std::move(path)});
+            }
+        },
+        [&](std::vector<Match>& out) {
+            for (auto& m : out) matches[m.name].push_back(std::move(m));
+        });
+    if (!ok) return false;
+
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        if (matches[i].empty()) {
+            std::cout << "File not found";
+            if (filenames.size() > 1) std::cout << ": " << filenames[i];
+            std::cout << "\n";
+        }
+        else if (matches[i].size() == 1 && filenames.size() == 1) {
+            std::cout << matches[i][0].hash << "\n";
+        }
+        else {
+            for (const auto& m : matches[i]) std::cout << m.hash << "  " << m.path << "\n";
+        }
+    }
+    return true;
+}
+
+//runs f(i) for every i in [0, n) on `threads` threads, each taking the next i in turn
+template <typename F>
+static void parallelFor(size_t n, int threads, F f)
+{
+    std::atomic<size_t> next{0};
+    auto work = [&] {
+        for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < n; ) f(i);
+    };
+    std::vector<std::thread> helpers;
+    for (int t = 1; t < threads && static_cast<size_t>(t) < n; ++t) helpers.emplace_back(work);
+    work();
+    for (auto& t : helpers) t.join();
+}
+
+//bytes hashed from each end of a file by the partial stage of findDupes
+static constexpr uint64_t DUPES_EDGE = 4 * 1024;
+
+//XXH3 of a file's first and last DUPES_EDGE bytes, a cheap fingerprint that
+//tells most same-sized files apart; false if the file cannot be read in full
+static bool edgeHash(const fs::path& p, uint64_t size, uint64_t& hash)
+{
+    int fd = ::open(p.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    uint8_t buf[2 * DUPES_EDGE];
+    const size_t head = static_cast<size_t>(std::min(size, DUPES_EDGE));
+    const size_t tail = static_cast<size_t>(std::min(size - head, DUPES_EDGE));
+    const bool ok = preadAll(fd, buf, head, 0) && preadAll(fd, buf + head, tail, size - tail);
+    ::close(fd);
+    if (ok) {
+        XXH3 h;
+        h.update(buf, head + tail);
+        hash = h.finalize();
+    }
+    return ok;
+}
+
+//DUPLICATE FILES: lists the tree without reading any file, then narrows the
+//candidates in stages, each reading more of fewer files: files of a size no
+//other file has are dropped, then files whose first and last 4 KB differ from
+//every other file of their size, and only the files still colliding are hashed
+//in full. prints each set of identical files as "<hash>  <path>" lines, largest
+//files first, sets separated by a blank line; empty files are not reported
+static void findDupes(const fs::path& root, IndexConfig cfg)
+{
+    cfg.hashContents = false;
+    IndexStats stats;
+    RecordStore records = indexDirectory(root, cfg, stats);
+    uint64_t totalBytes = 0, readBytes = 0;
+    for (const auto& r : records) totalBytes += r.size;
+
+    //calls f(first, last) for each run of at least two candidates with equal key(i)
+    auto forEachRun = [](std::vector<uint32_t>& c, auto key, auto f) {
+        for (size_t first = 0; first < c.size(); ) {
+            size_t last = first + 1;
+            while (last < c.size() && key(c[last]) == key(c[first])) ++last;
+            if (last - first >= 2) f(first, last);
+            first = last;
+        }
+    };
+    auto sizeOf = [&](uint32_t i) { return records[i].size; };
+
+    //stage 1: files sharing their size with another, no file read yet
+    std::vector<uint32_t> sameSize;
+    {
+        std::vector<uint32_t> all(records.size());
+        for (size_t i = 0; i < all.size(); ++i) all[i] = static_cast<uint32_t>(i);
+        std::sort(all.begin(), all.end(), [&](uint32_t a, uint32_t b) {
+            return records[a].size > records[b].size;
+        });
+        forEachRun(all, sizeOf, [&](size_t first, size_t last) {
+            if (records[all[first]].size > 0) sameSize.insert(sameSize.end(), all.begin() + first, all.begin() + last);
+        });
+    }
+
+    //stage 2: of those, files whose ends match another file of their size; files of
+    //up to two edges are read whole by the next stage instead, costing no more
+    std::vector<uint64_t> edge(records.size(), 0);
+    std::vector<char> readable(records.size(), 1);
+    std::vector<uint32_t> sampled;
+    for (uint32_t i : sameSize) {
+        if (records[i].size > 2 * DUPES_EDGE) sampled.push_back(i);
+    }
+    parallelFor(sampled.size(), cfg.fixedThreads(), [&](size_t k) {
+        const Record& r = records[sampled[k]];
+        readable[sampled[k]] = edgeHash(fs::path(std::string(records.path(r))), r.size, edge[sampled[k]]);
+    });
+    readBytes += sampled.size() * 2 * DUPES_EDGE;
+
+    std::vector<uint32_t> colliding;
+    for (size_t first = 0; first < sameSize.size(); ) {
+        size_t last = first + 1;
+        while (last < sameSize.size() && sizeOf(sameSize[last]) == sizeOf(sameSize[first])) ++last;
+        std::vector<uint32_t> group;
+        for (size_t k = first; k < last; ++k) {
+            if (readable[sameSize[k]]) group.push_back(sameSize[k]);
+        }
+        std::sort(group.begin(), group.end(), [&](uint32_t a, uint32_t b) { return edge[a] < edge[b]; });
+        forEachRun(group, [&](uint32_t i) { return edge[i]; }, [&](size_t f, size_t l) {
+            colliding.insert(colliding.end(), group.begin() + f, group.begin() + l);
+        });
+        first = last;
+    }
+
+    //stage 3: full content hashes, largest files first so the longest ones start early
+    parallelFor(colliding.size(), cfg.fixedThreads(), [&](size_t k) {
+        Record& r = records[colliding[k]];
+        r.digest = hashFile(fs::path(std::string(records.path(r))), cfg.read, cfg.hash);
+    });
+    for (uint32_t i : colliding) readBytes += records[i].size;
+
+    auto digestLess = [&](uint32_t a, uint32_t b) {
+        const FileDigest& x = records[a].digest;
+        const FileDigest& y = records[b].digest;
+        if (records[a].size != records[b].size) return records[a].size > records[b].size;
+        if (x.bytes != y.bytes) return x.bytes < y.bytes;
+        return records.path(records[a]) < records.path(records[b]);
+    };
+    std::sort(colliding.begin(), colliding.end(), digestLess);
+    colliding.erase(std::remove_if(colliding.begin(), colliding.end(),
+                                   [&](uint32_t i) { return records[i].digest.len == 0; }),
+                    colliding.end());
+
+    uint64_t sets = 0, extra = 0, wasted = 0;
+    forEachRun(colliding,
+        [&](uint32_t i) { return std::make_pair(records[i].size, records[i].digest.bytes); },
+        [&](size_t first, size_t last) {
+            if (sets++ > 0) std::cout << "\n";
+            const std::string hex = records[colliding[first]].digest.hex();
+            for (size_t k = first; k < last; ++k) {
+                std::cout << hex << "  " << records.path(records[colliding[k]]) << "\n";
+            }
+            extra += last - first - 1;
+            wasted += (last - first - 1) * records[colliding[first]].size;
+        });
+
+    std::cerr << sets << " sets of duplicates, " << extra << " redundant files ("
+              << wasted << " bytes); read " << readBytes << " of " << totalBytes
+              << " bytes in " << records.size() << " files\n";
+}
+
+#if INDEXER_SERVE
+//`serve` keeps one tree's index resident and current: inotify reports every
+//change under the root, changed paths are collected until they settle so a
+//burst of writes to one file costs one re-hash, and queries are answered over
+//a Unix domain socket from memory
+
+static const char* DEFAULT_SOCKET = "cpp-indexer.sock";
+//changes are applied at the latest this long after the first of a batch, even
+//when events keep arriving
+static constexpr unsigned SERVE_MAX_DELAY_MS = 1000;
+
+//the records of a served tree, updated in place as files change. queries read
+//under a shared lock; files are hashed before the exclusive lock is taken, so a
+//query never waits for a hash
+class LiveIndex {
+public:
+    //what a path holds after a change; `present` false means it is no longer a file
+    struct Update {
+        std::string path;
+        bool present = false;
+        uint64_t size = 0;
+        uint64_t mtime = 0;
+        FileDigest digest;
+
+        static Update gone(std::string path) {
+            Update u;
+            u.path = std::move(path);
+            return u;
+        }
+    };
+
+    explicit LiveIndex(RecordStore&& records) : records_(std::move(records)) { rebuild(); }
+
+    //"<hash>  <path>" for every file named `filename`, in record order
+    std::string checksum(std::string_view filename) const {
+        std::shared_lock<std::shared_mutex> lock(m_);
+        std::string out;
+        auto it = byName_.find(filename);
+        if (it == byName_.end()) return out;
+        for (uint32_t i : it->second) {
+            const Record& r = records_[i];
+            out += r.digest.hex();
+            out += "  ";
+            out += records_.path(r);
+            out += '\n';
+        }
+        return out;
+    }
+
+    //"<path> <size>" for every file larger than `minMB`, smallest first
+    std::string find(uint64_t minMB) const {
+        std::shared_lock<std::shared_mutex> lock(m_);
+        const std::shared_ptr<const SizeOrder> order = sizeOrder();
+        std::string out;
+        auto range = order->largerThan(minMB * 1024ULL * 1024ULL);
+        for (const uint32_t* i = range.first; i != range.second; ++i) {
+            if (dead_[*i]) continue;
+            const Record& r = records_[*i];
+            out += records_.path(r);
+            out += ' ';
+            out += std::to_string(r.size);
+            out += '\n';
+        }
+        return out;
+    }
+
+    //whether `path` is indexed with this size and mtime, ie: unchanged since it was hashed
+    bool current(const std::string& path, uint64_t size, uint64_t mtime) const {
+        std::shared_lock<std::shared_mutex> lock(m_);
+        auto it = byPath_.find(path);
+        return it != byPath_.end() && records_[it->second].size == size &&
+               records_[it->second].mtime == mtime;
+    }
+
+    //every indexed path below the directory `dir`
+    std::vector<std::string> pathsUnder(const std::string& dir) const {
+        std::shared_lock<std::shared_mutex> lock(m_);
+        std::vector<std::string> paths;
+        for (const auto& entry : byPath_) {
+            const std::string_view p = entry.first;
+            if (p.size() > dir.size() && p[dir.size()] == '/' && p.compare(0, dir.size(), dir) == 0) {
+                paths.emplace_back(p);
+            }
+        }
+        return paths;
+    }
+
+    void apply(const std::vector<Update>& updates) {
+        if (updates.empty()) return;
+        std::unique_lock<std::shared_mutex> lock(m_);
+        for (const Update& u : updates) {
+            auto it = byPath_.find(u.path);
+            if (!u.present) {
+                if (it != byPath_.end()) remove(it);
+                continue;
+            }
+            if (it != byPath_.end()) {
+                //the path stays where it is in the arena, only the metadata changes
+                Record& r = records_[it->second];
+                r.size = u.size;
+                r.mtime = u.mtime;
+                r.digest = u.digest;
+                continue;
+            }
+            Record& r = records_.add(u.path, u.size, u.mtime);
+            r.digest = u.digest;
+            const uint32_t i = static_cast<uint32_t>(records_.size() - 1);
+            dead_.push_back(false);
+            byPath_.emplace(records_.path(r), i);
+            byName_[records_.filename(r)].push_back(i);
+        }
+        updates_ += updates.size();
+        orderStale_ = true;
+        //removed records are only skipped; they are dropped once they outnumber the live ones
+        if (deadCount_ > COMPACT_MIN && deadCount_ > records_.size() / 2) compact();
+    }
+
+    //writes the index as `index` would, for the next start (or any other mode) to load
+    bool save(const fs::path& file, const fs::path& root, HashAlgo algo) {
+        std::unique_lock<std::shared_mutex> lock(m_);
+        if (deadCount_ > 0) compact();
+        return saveIndex(file, root, algo, records_);
+    }
+
+    size_t files() const {
+        std::shared_lock<std::shared_mutex> lock(m_);
+        return records_.size() - deadCount_;
+    }
+
+    uint64_t updates() const {
+        std::shared_lock<std::shared_mutex> lock(m_);
+        return updates_;
+    }
+
+private:
+    static constexpr size_t COMPACT_MIN = 4096;
+
+    using Paths = std::unordered_map<std::string_view, uint32_t>;
+
+    void remove(Paths::iterator it) {
+        const uint32_t i = it->second;
+        auto names = byName_.find(records_.filename(records_[i]));
+        auto& list = names->second;
+        list.erase(std::find(list.begin(), list.end(), i));
+        if (list.empty()) byName_.erase(names);
+        byPath_.erase(it);
+        dead_[i] = true;
+        ++deadCount_;
+    }
+
+    //copies the live records into a fresh store, dropping the removed ones
+    void compact() {
+        RecordStore live;
+        live.reserve(records_.size() - deadCount_);
+        for (size_t i = 0; i < records_.size(); ++i) {
+            if (dead_[i]) continue;
+            const Record& r = records_[i];
+            live.add(records_.path(r), r.size, r.mtime).digest = r.digest;
+        }
+        byPath_.clear();
+        byName_.clear();
+        records_ = std::move(live);
+        rebuild();
+    }
+
+    void rebuild() {
+        dead_.assign(records_.size(), false);
+        deadCount_ = 0;
+        byPath_.reserve(records_.size());
+        for (size_t i = 0; i < records_.size(); ++i) {
+            const Record& r = records_[i];
+            byPath_.emplace(records_.path(r), static_cast<uint32_t>(i));
+            byName_[records_.filename(r)].push_back(static_cast<uint32_t>(i));
+        }
+        orderStale_ = true;
+    }
+
+    //the size order, rebuilt by the first `find` after a change; called under the shared lock
+    std::shared_ptr<const SizeOrder> sizeOrder() const {
+        std::lock_guard<std::mutex> lock(orderMutex_);
+        if (orderStale_ || !order_) {
+            order_ = std::make_shared<const SizeOrder>(records_);
+            orderStale_ = false;
+        }
+        return order_;
+    }
+
+    mutable std::shared_mutex m_;
+    RecordStore records_;
+    std::vector<bool> dead_;
+    size_t deadCount_ = 0;
+    uint64_t updates_ = 0;
+    //keys point into the records' path arena, which only compact() replaces
+    Paths byPath_;
+    std::unordered_map<std::string_view, std::vector<uint32_t>> byName_;
+    mutable std::mutex orderMutex_;
+    mutable std::shared_ptr<const SizeOrder> order_;
+    mutable bool orderStale_ = true;
+};
+
+//inotify watches on every directory of a tree, each mapped to the directory's path
+//paths are given and reported spelled as under `root` as given, like the indexed
+//records, while the watches are kept under the normalized root
+class TreeWatcher {
+public:
+    explicit TreeWatcher(const fs::path& root)
+        : fd_(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC)), spelled_(root.native()), normal_(normalRoot(root)) {
+        if (!spelled_.empty() && spelled_.back() == '/') spelled_.pop_back();
+        if (normal_ == "/") normal_.clear();
+    }
+    ~TreeWatcher() { if (fd_ >= 0) ::close(fd_); }
+
+    TreeWatcher(const TreeWatcher&) = delete;
+    TreeWatcher& operator=(const TreeWatcher&) = delete;
+
+    bool ok() const { return fd_ >= 0; }
+    int fd() const { return fd_; }
+
+    //watches `dir` and every directory below it (symlinks are not followed, as in
+    //indexing), calling onFile(path) for each regular file found on the way
+    template <typename F>
+    void watchTree(const std::string& dir, F onFile) {
+        const fs::path watched = respell(dir, spelled_, normal_);
+        add(watched);
+        std::error_code ec;
+        for (auto it = fs::recursive_directory_iterator(watched, fs::directory_options::skip_permission_denied, ec);
+             !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            if (it->is_symlink(ec) ? false : it->is_directory(ec)) add(it->path());
+            else if (it->is_regular_file(ec)) onFile(fs::path(respell(it->path().native(), normal_, spelled_)));
+        }
+    }
+
+    //the root as the paths reported are spelled
+    std::string root() const { return spelled_.empty() ? "/" : spelled_; }
+
+    //drops the watches of `dir` and every directory below it
+    void unwatchTree(const std::string& dir) {
+        std::lock_guard<std::mutex> lock(m_);
+        for (auto it = dirs_.begin(); it != dirs_.end();) {
+            const std::string& p = it->second;
+            if (p == dir || (p.size() > dir.size() && p[dir.size()] == '/' && p.compare(0, dir.size(), dir) == 0)) {
+                ::inotify_rm_watch(fd_, it->first);
+                it = dirs_.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+    //reads every queued event, calling onChange(path, isDir) for each changed
+    //entry; false if the kernel's queue overflowed and events were lost
+    template <typename F>
+    bool read(F onChange) {
+        bool complete = true;
+        alignas(struct inotify_event) char buf[64 * 1024];
+        for (;;) {
+            const ssize_t n = ::read(fd_, buf, sizeof(buf));
+            if (n <= 0) break;
+            for (ssize_t off = 0; off < n;) {
+                const auto* e = reinterpret_cast<const struct inotify_event*>(buf + off);
+                off += sizeof(struct inotify_event) + e->len;
+                if (e->mask & IN_Q_OVERFLOW) {
+                    complete = false;
+                    continue;
+                }
+                std::string path;
+                {
+                    std::lock_guard<std::mutex> lock(m_);
+                    auto it = dirs_.find(e->wd);
+                    if (it == dirs_.end()) continue;
+                    if (e->mask & IN_IGNORED) {
+                        dirs_.erase(it);
+                        continue;
+                    }
+                    path = it->second;
+                }
+                if (e->len == 0) continue; //the directory itself; its parent reports it
+                path += '/';
+                path += e->name;
+                const bool isDir = e->mask & IN_ISDIR;
+                if (isDir && (e->mask & IN_MOVED_FROM)) unwatchTree(path);
+                if (isDir && (e->mask & IN_ATTRIB)) continue;
+                onChange(respell(path, normal_, spelled_), isDir);
+            }
+        }
+        return complete;
+    }
+
+private:
+    //`path` under the root spelled `from` (without its trailing '/'), spelled `to` instead
+    static std::string respell(const std::string& path, const std::string& from, const std::string& to) {
+        const std::string fromRoot = from.empty() ? "/" : from;
+        if (path == fromRoot) return to.empty() ? "/" : to;
+        if (path.size() > from.size() && path[from.size()] == '/' && path.compare(0, from.size(), from) == 0) {
+            return to + path.substr(from.size());
+        }
+        return path;
+    }
+
+    static constexpr uint32_t EVENTS = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE |
+                                       IN_MOVED_FROM | IN_MOVED_TO | IN_EXCL_UNLINK;
+
+    void add(const fs::path& dir) {
+        const int wd = ::inotify_add_watch(fd_, dir.c_str(), EVENTS | IN_ONLYDIR | IN_DONT_FOLLOW);
+        if (wd < 0) {
+            if (errno == ENOSPC) {
+                static std::once_flag warned;
+                std::call_once(warned, [] {
+                    std::cerr << "Out of inotify watches (fs.inotify.max_user_watches), "
+                                 "some directories are not watched\n";
+                });
+            }
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_);
+        dirs_[wd] = dir.string();
+    }
+
+    int fd_;
+    //the root as given and normalized, each without a trailing '/'
+    std::string spelled_;
+    std::string normal_;
+    std::mutex m_;
+    std::unordered_map<int, std::string> dirs_;
+};
+
+//changed paths waiting to be applied; true marks a directory to rescan
+using ServeChanges = std::map<std::string, bool>;
+
+//brings the index up to date with one batch of changes. a changed file is always
+//re-hashed; the files found by rescanning a directory are re-hashed only when
+//their size or mtime differ from the index, and indexed paths no longer there are removed
+static void applyChanges(const ServeChanges& changes, LiveIndex& live, TreeWatcher& watcher,
+                         const IndexConfig& cfg)
+{
+    //(path, re-hash even if size and mtime match)
+    std::vector<std::pair<std::string, bool>> check;
+    std::vector<LiveIndex::Update> updates;
+    for (const auto& change : changes) {
+        const std::string& path = change.first;
+        std::error_code ec;
+        if (change.second && fs::is_directory(fs::symlink_status(path, ec))) {
+            std::unordered_set<std::string> found;
+            watcher.watchTree(path, [&](const fs::path& p) { found.insert(p.string()); });
+            for (auto& p : live.pathsUnder(path)) {
+                if (!found.count(p)) updates.push_back(LiveIndex::Update::gone(std::move(p)));
+            }
+            for (const auto& p : found) check.emplace_back(p, false);
+        }
+        else {
+            if (change.second) {
+                for (auto& p : live.pathsUnder(path)) updates.push_back(LiveIndex::Update::gone(std::move(p)));
+            }
+            check.emplace_back(path, true);
+        }
+    }
+
+    std::vector<LiveIndex::Update> checked(check.size());
+    std::vector<char> unchanged(check.size(), 0);
+    parallelFor(check.size(), cfg.fixedThreads(), [&](size_t i) {
+        LiveIndex::Update& u = checked[i];
+        u.path = check[i].first;
+        struct stat st;
+        if (::stat(u.path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return;
+        u.present = true;
+        u.size = static_cast<uint64_t>(st.st_size);
+        u.mtime = statMtime(st);
+        if (!check[i].second && live.current(u.path, u.size, u.mtime)) {
+            unchanged[i] = 1;
+            return;
+        }
+        if (cfg.hashContents) u.digest = hashFile(u.path, cfg.read, cfg.hash);
+    });
+    for (size_t i = 0; i < checked.size(); ++i) {
+        if (!unchanged[i]) updates.push_back(std::move(checked[i]));
+    }
+    live.apply(updates);
+}
+
+//the answer to one request line, ended by an empty line:
+//  checksum <filename>  ->  "<hash>  <path>" per file with that name
+//  find <MB>            ->  "<path> <size>" per file larger than MB, smallest first
+//  status               ->  "files <n>", "pending <n>" (changes not applied yet), "updates <n>"
+static std::string serveRequest(std::string_view line, const LiveIndex& live, size_t pending)
+{
+    std::string out;
+    uint64_t mb;
+    if (line.compare(0, 9, "checksum ") == 0) {
+        out = live.checksum(line.substr(9));
+    }
+    else if (line.compare(0, 5, "find ") == 0 &&
+             std::from_chars(line.data() + 5, line.data() + line.size(), mb).ec == std::errc()) {
+        out = live.find(mb);
+    }
+    else if (line == "status") {
+        out = "files " + std::to_string(live.files()) + "\npending " + std::to_string(pending) +
+              "\nupdates " + std::to_string(live.updates()) + "\n";
+    }
+    else {
+        out = "error unknown request\n";
+    }
+    out += '\n';
+    return out;
+}
+
+//a Unix socket address for `path`; false if the path is too long for one
+static bool socketAddress(const fs::path& path, sockaddr_un& addr)
+{
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.native().size() >= sizeof(addr.sun_path)) return false;
+    std::memcpy(addr.sun_path, path.c_str(), path.native().size());
+    return true;
+}
+
+//listens on `path`, replacing a stale socket file but not a running server
+static int listenSocket(const fs::path& path)
+{
+    sockaddr_un addr;
+    if (!socketAddress(path, addr)) return -1;
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+        ::close(fd);
+        errno = EADDRINUSE;
+        return -1;
+    }
+    ::unlink(path.c_str());
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, 128) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+//one client connection: the bytes of its unfinished request and of answers not yet sent
+struct ServeClient {
+    int fd;
+    std::string in;
+    std::string out;
+};
+
+//indexes `root` (incrementally against `indexFile` when it indexes the same
+//root), then keeps that index current and answers queries on `socketPath` until
+//SIGINT or SIGTERM, when the index is saved back to `indexFile`
+static int serve(const fs::path& root, const IndexConfig& cfg, const fs::path& indexFile,
+                 bool writeIndex, const fs::path& socketPath, unsigned settleMs)
+{
+    //the signals are taken from a signalfd in the loop below, so every thread
+    //started from here on has them blocked
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    ::pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    const int sigFd = ::signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    TreeWatcher watcher(root);
+    if (!watcher.ok() || sigFd < 0) {
+        std::cerr << "Failed to watch " << root.string() << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    //the records, answers and saved index spell paths with the root as given,
+    //as `index` does, so either reuses the other's hashes
+    const std::string rootPath = watcher.root();
+    //watches go up before the tree is indexed, so no change made meanwhile is missed
+    watcher.watchTree(rootPath, [](const fs::path&) {});
+
+    IndexConfig initial = cfg;
+    RecordStore previousRecords;
+    PreviousIndex previous;
+    if (loadPrevious(indexFile, root, cfg.hash.algo, previousRecords, previous)) initial.previous = &previous;
+    IndexStats stats;
+    LiveIndex live(indexDirectory(root, initial, stats));
+    previous.clear();
+    previousRecords = RecordStore();
+    if (writeIndex && !live.save(indexFile, rootPath, cfg.hash.algo)) {
+        std::cerr << "Failed to write index " << indexFile.string() << "\n";
+    }
+
+    const int listenFd = listenSocket(socketPath);
+    if (listenFd < 0) {
+        std::cerr << "Failed to listen on " << socketPath.string() << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    std::cerr << "Serving " << live.files() << " files under " << rootPath << " on "
+              << socketPath.string() << " (" << stats.hashed.load() << " hashed, "
+              << stats.reused.load() << " unchanged)\n";
+
+    //the updater thread applies one batch at a time, while the loop below keeps
+    //collecting the next one
+    std::mutex batchMutex;
+    std::condition_variable batchReady;
+    ServeChanges batch;
+    bool updating = false, stopping = false;
+    std::atomic<size_t> applying{0};
+    std::thread updater([&] {
+        std::unique_lock<std::mutex> lock(batchMutex);
+        for (;;) {
+            batchReady.wait(lock, [&] { return !batch.empty() || stopping; });
+            if (batch.empty()) return;
+            ServeChanges work = std::move(batch);
+            batch.clear();
+            lock.unlock();
+            applyChanges(work, live, watcher, cfg);
+            applying.store(0);
+            lock.lock();
+            updating = false;
+        }
+    });
+
+    using Clock = std::chrono::steady_clock;
+    ServeChanges pending;
+    Clock::time_point firstChange, lastChange;
+    std::vector<ServeClient> clients;
+    std::vector<pollfd> fds;
+    bool running = true;
+
+    auto send = [](ServeClient& c) {
+        while (!c.out.empty()) {
+            const ssize_t n = ::send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n <= 0) return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+            c.out.erase(0, static_cast<size_t>(n));
+        }
+        return true;
+    };
+    //answers every complete request line; false when the client is gone
+    auto receive = [&](ServeClient& c) {
+        char buf[16 * 1024];
+        const ssize_t n = ::recv(c.fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) return false;
+        if (n > 0) c.in.append(buf, static_cast<size_t>(n));
+        size_t start = 0;
+        for (size_t nl; (nl = c.in.find('\n', start)) != std::string::npos; start = nl + 1) {
+            std::string_view line(c.in.data() + start, nl - start);
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            c.out += serveRequest(line, live, pending.size() + applying.load());
+        }
+        c.in.erase(0, start);
+        //a line longer than any path could be is not a request
+        return c.in.size() <= 64 * 1024 && send(c);
+    };
+
+    while (running) {
+        fds.clear();
+        fds.push_back({sigFd, POLLIN, 0});
+        fds.push_back({watcher.fd(), POLLIN, 0});
+        fds.push_back({listenFd, POLLIN, 0});
+        for (const auto& c : clients) {
+            fds.push_back({c.fd, static_cast<short>(POLLIN | (c.out.empty() ? 0 : POLLOUT)), 0});
+        }
+
+        int timeout = -1;
+        if (!pending.empty()) {
+            const auto due = std::min(lastChange + std::chrono::milliseconds(settleMs),
+                                      firstChange + std::chrono::milliseconds(SERVE_MAX_DELAY_MS));
+            timeout = static_cast<int>(std::max<int64_t>(0,
+                std::chrono::duration_cast<std::chrono::milliseconds>(due - Clock::now()).count() + 1));
+        }
+        if (::poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR) break;
+
+        if (fds[0].revents & POLLIN) running = false;
+        if (fds[1].revents & POLLIN) {
+            const bool wasEmpty = pending.empty();
+            const bool complete = watcher.read([&](const std::string& path, bool isDir) {
+                bool& tree = pending[path];
+                tree = tree || isDir;
+            });
+            //events were lost: the whole tree is checked against the index
+            if (!complete) pending[rootPath] = true;
+            if (!pending.empty()) {
+                lastChange = Clock::now();
+                if (wasEmpty) firstChange = lastChange;
+            }
+        }
+        if (fds[2].revents & POLLIN) {
+            for (int c; (c = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0; ) {
+                clients.push_back({c, {}, {}});
+            }
+        }
+        for (size_t i = 0, k = 3; i < clients.size(); ++k) {
+            const short ev = fds.size() > k ? fds[k].revents : 0;
+            bool alive = true;
+            if (ev & (POLLIN | POLLHUP | POLLERR)) alive = receive(clients[i]);
+            if (alive && (ev & POLLOUT)) alive = send(clients[i]);
+            if (alive) {
+                ++i;
+                continue;
+            }
+            ::close(clients[i].fd);
+            clients.erase(clients.begin() + i);
+        }
+
+        //hands the settled changes to the updater, unless it is still busy with the last batch
+        if (!pending.empty()) {
+            const auto now = Clock::now();
+            const bool settled = now >= lastChange + std::chrono::milliseconds(settleMs) ||
+                                 now >= firstChange + std::chrono::milliseconds(SERVE_MAX_DELAY_MS);
+            std::lock_guard<std::mutex> lock(batchMutex);
+            if (settled && !updating) {
+                applying.store(pending.size());
+                batch = std::move(pending);
+                pending.clear();
+                updating = true;
+                batchReady.notify_one();
+            }
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        stopping = true;
+    }
+    batchReady.notify_one();
+    updater.join();
+    for (const auto& c : clients) ::close(c.fd);
+    ::close(listenFd);
+    ::unlink(socketPath.c_str());
+    ::close(sigFd);
+
+    if (writeIndex && !live.save(indexFile, rootPath, cfg.hash.algo)) {
+        std::cerr << "Failed to write index " << indexFile.string() << "\n";
+        return 1;
+    }
+    std::cerr << "Stopped serving " << rootPath << " after " << live.updates() << " updates\n";
+    return 0;
+}
+
+//a connection to a `serve` daemon, for the find and checksum modes
+class ServeConnection {
+public:
+    explicit ServeConnection(const fs::path& path) {
+        sockaddr_un addr;
+        if (!socketAddress(path, addr)) return;
+        fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd_ >= 0 && ::connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+    ~ServeConnection() { if (fd_ >= 0) ::close(fd_); }
+
+    ServeConnection(const ServeConnection&) = delete;
+    ServeConnection& operator=(const ServeConnection&) = delete;
+
+    bool ok() const { return fd_ >= 0; }
+
+    //sends one request and returns the answer's lines, without the empty line that ends it
+    bool ask(const std::string& request, std::vector<std::string>& lines) {
+        lines.clear();
+        const std::string msg = request + "\n";
+        for (size_t sent = 0; sent < msg.size();) {
+            const ssize_t n = ::send(fd_, msg.data() + sent, msg.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) return false;
+            sent += static_cast<size_t>(n);
+        }
+        for (;;) {
+            const size_t nl = buf_.find('\n');
+            if (nl == std::string::npos) {
+                char chunk[64 * 1024];
+                const ssize_t n = ::recv(fd_, chunk, sizeof(chunk), 0);
+                if (n <= 0) return false;
+                buf_.append(chunk, static_cast<size_t>(n));
+                continue;
+            }
+            std::string line = buf_.substr(0, nl);
+            buf_.erase(0, nl + 1);
+            if (line.empty()) return true;
+            lines.push_back(std::move(line));
+        }
+    }
+
+private:
+    int fd_ = -1;
+    std::string buf_;
+};
+
+//CLI QUERY against a `serve` daemon: the output matches queryFind and queryChecksum
+static bool queryServer(const fs::path& socketPath, const std::string& mode,
+                        const std::vector<std::string>& args)
+{
+    ServeConnection conn(socketPath);
+    if (!conn.ok()) return false;
+    std::vector<std::string> lines;
+    if (mode == "find") {
+        if (!conn.ask("find " + args[0], lines)) return false;
+        for (const auto& l : lines) std::cout << l << "\n";
+        return true;
+    }
+    for (const auto& filename : args) {
+        if (!conn.ask("checksum " + filename, lines)) return false;
+        if (lines.empty()) {
+            std::cout << "File not found";
+            if (args.size() > 1) std::cout << ": " << filename;
+            std::cout << "\n";
+        }
+        else if (lines.size() == 1 && args.size() == 1) {
+            std::cout << lines[0].substr(0, lines[0].find(' ')) << "\n";
+        }
+        else {
+            for (const auto& l : lines) std::cout << l << "\n";
+        }
+    }
+    return true;
+}
+#endif
+
+//how `bench` treats the page cache before each timed run
+//Warm: one untimed run first, so every run reads from memory
+//Cold: the tree's data is dropped from the cache before every run
+enum class BenchCache { Warm, Cold };
+
+//drops the tree from the page cache: the whole cache through drop_caches when
+//permitted (root), so directories and inodes are cold too; otherwise each file's
+//cached data through posix_fadvise. returns which of the two was done
+static const char* evictCache(const fs::path& root)
+{
+    ::sync();
+    {
+        std::ofstream drop("/proc/sys/vm/drop_caches");
+        if (drop && (drop << "3").flush()) return "drop_caches";
+    }
+    std::error_code ec;
+    for (auto it = fs::recursive_directory_iterator(root, ec); !ec && it != fs::recursive_directory_iterator();
+         it.increment(ec)) {
+        if (!it->is_regular_file(ec)) continue;
+        int fd = ::open(it->path().c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+    }
+    return "fadvise";
+}
+
+//one timed indexing run; times in seconds, the phases summed over the workers
+struct BenchRun {
+    double wall = 0;
+    uint64_t files = 0;
+    uint64_t bytes = 0;
+    double traverse = 0, stat = 0, read = 0, hash = 0;
+    double p50 = 0, p99 = 0;
+};
+
+//nearest-rank percentile of sorted nanoseconds, in seconds
+static double percentile(const std::vector<uint64_t>& sorted, double pct)
+{
+    if (sorted.empty()) return 0;
+    size_t rank = static_cast<size_t>(pct / 100.0 * sorted.size() + 0.999999);
+    rank = std::min(std::max<size_t>(rank, 1), sorted.size());
+    return sorted[rank - 1] / 1e9;
+}
+
+static BenchRun benchRun(const fs::path& root, const IndexConfig& cfg)
+{
+    IndexStats stats;
+    stats.phases.resize(static_cast<size_t>(std::max(1, cfg.workers)));
+    const auto start = std::chrono::steady_clock::now();
+    RecordStore records = indexDirectory(root, cfg, stats);
+
+    BenchRun run;
+    run.wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    run.files = records.size();
+    for (const auto& r : records) run.bytes += r.size;
+    std::vector<uint64_t> latencies;
+    for (auto& p : stats.phases) {
+        run.stat += p.stat / 1e9;
+        run.read += p.read / 1e9;
+        run.hash += p.hash / 1e9;
+        latencies.insert(latencies.end(), p.latencies.begin(), p.latencies.end());
+    }
+    run.traverse = stats.traverseNs / 1e9;
+    std::sort(latencies.begin(), latencies.end());
+    run.p50 = percentile(latencies, 50);
+    run.p99 = percentile(latencies, 99);
+    return run;
+}
+
+//BENCHMARK: indexes the tree `runs` times without saving an index and reports,
+//per run, where the time went: directory traversal, stat, read and hash (summed
+//over the threads, so they can exceed the wall time), throughput, and the
+//p50/p99 time per file. `json` prints one JSON object instead of a table, with
+//the build and settings included so results can be compared across builds
+static void bench(const fs::path& root, const IndexConfig& cfg, unsigned runs,
+                  BenchCache cache, bool json)
+{
+    const char* cacheMode = "warm";
+    if (cache == BenchCache::Warm) {
+        IndexStats untimed;
+        indexDirectory(root, cfg, untimed);
+    }
+    std::vector<BenchRun> results;
+    for (unsigned i = 0; i < std::max(1u, runs); ++i) {
+        if (cache == BenchCache::Cold) cacheMode = evictCache(root);
+        results.push_back(benchRun(root, cfg));
+        if (!json) {
+            const BenchRun& r = results.back();
+            std::cout << std::fixed << std::setprecision(3)
+                      << "run " << i + 1 << ": " << r.wall << " s  " << r.files << " files  "
+                      << std::setprecision(1) << r.files / r.wall << " files/s  "
+                      << r.bytes / r.wall / (1 << 20) << " MB/s\n"
+                      << std::setprecision(3)
+                      << "  traverse " << r.traverse << " s  stat " << r.stat << " s  read "
+                      << r.read << " s  hash " << r.hash << " s\n"
+                      << std::setprecision(1)
+                      << "  latency p50 " << r.p50 * 1e6 << " us  p99 " << r.p99 * 1e6 << " us\n";
+        }
+    }
+    //the run with the median wall time
+    std::vector<BenchRun> byWall = results;
+    std::sort(byWall.begin(), byWall.end(), [](const BenchRun& a, const BenchRun& b) { return a.wall < b.wall; });
+    const BenchRun& median = byWall[(byWall.size() - 1) / 2];
+    if (!json) {
+        std::cout << std::fixed << std::setprecision(3) << "median: " << median.wall << " s  "
+                  << std::setprecision(1) << median.files / median.wall << " files/s  "
+                  << median.bytes / median.wall / (1 << 20) << " MB/s  (" << cacheMode << " cache)\n";
+        return;
+    }
+
+    std::string out = "{\"root\": ";
+    appendJsonString(out, root.native());
+    auto field = [&out](const char* name, const std::string& value) {
+        out += ", \"";
+        out += name;
+        out += "\": ";
+        out += value;
+    };
+    auto str = [](std::string_view v) {
+        std::string s;
+        appendJsonString(s, v);
+        return s;
+    };
+    auto num = [](double v) {
+        char buf[32];
+        return std::string(buf, std::to_chars(buf, buf + sizeof(buf), v).ptr);
+    };
+    auto runJson = [&](const BenchRun& r) {
+        return "{\"wall_s\": " + num(r.wall) + ", \"files\": " + std::to_string(r.files) +
+               ", \"bytes\": " + std::to_string(r.bytes) +
+               ", \"files_per_s\": " + num(r.files / r.wall) +
+               ", \"mb_per_s\": " + num(r.bytes / r.wall / (1 << 20)) +
+               ", \"traverse_s\": " + num(r.traverse) + ", \"stat_s\": " + num(r.stat) +
+               ", \"read_s\": " + num(r.read) + ", \"hash_s\": " + num(r.hash) +
+               ", \"latency_p50_s\": " + num(r.p50) + ", \"latency_p99_s\": " + num(r.p99) + "}";
+    };
+#if defined(__OPTIMIZE__)
+    const bool optimized = true;
+#else
+    const bool optimized = false;
+#endif
+    field("compiler", str(__VERSION__));
+    field("optimized", optimized ? "true" : "false");
+    field("sha256", str(SHA256::implementation()));
+    field("blake3", str(BLAKE3::implementation()));
+    field("workers", std::to_string(cfg.workers));
+    field("auto_start", std::to_string(cfg.autoStart));
+    field("storage", str(storageName(storageOf(root))));
+    field("pin", str(cfg.pin == IndexConfig::Pin::Cores ? "cores"
+                     : cfg.pin == IndexConfig::Pin::Nodes ? "nodes" : "none"));
+    field("io", str(cfg.read.engine == ReadOptions::Engine::Uring ? "uring" : "sync"));
+    field("scan", str(cfg.parallelScan ? "parallel" : "sequential"));
+    field("schedule", str(cfg.schedule == IndexConfig::Schedule::LargestFirst ? "lpt" : "fifo"));
+    field("hash", str(hashAlgoName(cfg.hash.algo)));
+    field("batch_kb", std::to_string(cfg.batchLimit / 1024));
+    field("mmap_mb", std::to_string(cfg.read.mmapThreshold >> 20));
+    field("page_cache", str(cfg.read.cache == ReadOptions::Cache::Direct ? "direct"
+                            : cfg.read.cache == ReadOptions::Cache::Drop ? "drop" : "keep"));
+    field("read_kb", std::to_string(cfg.read.readSize / 1024));
+    field("cache", str(cacheMode));
+    std::string list = "[";
+    for (size_t i = 0; i < results.size(); ++i) list += (i ? ", " : "") + runJson(results[i]);
+    field("runs", list + "]");
+    field("median", runJson(median));
+    std::cout << out << "}\n";
+}
+
+//MICROBENCHMARK: pushes `items` paths from one producer through a JobQueue to
+//1..64 consumer threads that do nothing but count them, once with per-file
+//push/pop and once in batches through JobQueue::Consumer, and prints the
+//throughput for each thread count
+static void queueBench(size_t items)
+{
+    std::vector<JobQueue::Job> paths;
+    paths.reserve(items);
+    for (size_t i = 0; i < items; ++i) {
+        paths.push_back({"bench/dir" + std::to_string(i % 1000) + "/file" + std::to_string(i), 0});
+    }
+
+    for (bool batched : {false, true}) {
+        for (int threads = 1; threads <= 64; threads *= 2) {
+            std::vector<JobQueue::Job> work = paths;
+            JobQueue q(threads);
+            std::atomic<size_t> consumed{0};
+
+            auto start = std::chrono::steady_clock::now();
+            std::vector<std::thread> consumers;
+            for (int t = 0; t < threads; ++t) {
+                consumers.emplace_back([&] {
+                    fs::path p;
+                    size_t n = 0;
+                    if (batched) {
+                        JobQueue::Consumer c(q);
+                        while (c.pop(p)) ++n;
+                    }
+                    else {
+                        while (q.pop(p)) ++n;
+                    }
+                    consumed.fetch_add(n);
+                });
+            }
+            if (batched) {
+                std::vector<JobQueue::Job> batch;
+                for (auto& j : work) {
+                    batch.push_back(std::move(j));
+                    if (batch.size() >= JobQueue::Consumer::BATCH) q.push(batch);
+                }
+                q.push(batch);
+            }
+            else {
+                for (auto& j : work) q.push(std::move(j.path));
+            }
+            q.done();
+            for (auto& t : consumers) t.join();
+            double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            std::cout << (batched ? "batched " : "per-file") << "  threads=" << std::setw(2) << threads
+                      << "  " << std::fixed << std::setprecision(2)
+                      << consumed.load() / secs / 1e6 << " M jobs/s\n";
+        }
+    }
+}
+
+//command-line options: positional arguments plus `--name value` flags
+struct Options {
+    std::string mode;
+    std::vector<std::string> args;
+    //the numbers among the positional arguments: the worker count after the root
+    //(0: auto), find's size threshold in MB and queue-bench's job count
+    int workers = 0;
+    uint64_t minMB = 0;
+    size_t jobs = 500000;
+    fs::path indexFile = DEFAULT_INDEX_FILE;
+    //index mode: JSONL output file, if any, and whether the binary index is written
+    fs::path jsonlFile;
+    bool writeIndex = true;
+    //index mode: seconds between live stats lines (0: none) and the metrics file, if any
+    double statsInterval = 0;
+    fs::path metricsFile;
+    //index mode: the persisted inode cache, if any
+    fs::path inodeCache;
+    //index mode: seconds between checkpoint syncs (0: no journal unless resuming),
+    //and whether to resume from the journal of an interrupted run
+    double checkpointSeconds = 0;
+    bool resume = false;
+    //serve mode: the socket to listen on and how long changes settle before they
+    //are applied; find/checksum ask the daemon on `socket` when it is given
+    fs::path socket;
+    unsigned settleMs = 50;
+    //find, checksum and du: the directory and filename glob queried
+    QueryScope scope;
+    bool incremental = false;
+    uint64_t batchKB = 16;
+    uint64_t mmapMB = 16;
+    ReadOptions::Engine io = ReadOptions::Engine::Sync;
+    unsigned ioDepth = 32;
+    ReadOptions::Cache pageCache = ReadOptions::Cache::Keep;
+    //0: each engine's own read size
+    uint64_t readKB = 0;
+    IndexConfig::Pin pin = IndexConfig::Pin::None;
+    //index mode: the part of the tree this shard covers, as given and as read by parseShard
+    std::string shardSpec;
+    uint32_t shard = 0;
+    uint32_t shards = 1;
+    std::vector<fs::path> subtrees;
+    bool parallelScan = true;
+    //threads reading for the staged pipeline; 0 runs the fused workers
+    int readers = 0;
+    IndexConfig::Schedule schedule = IndexConfig::Schedule::Fifo;
+    HashOptions hash;
+    //false: indexConfig spreads the cores over the workers
+    bool treeThreadsGiven = false;
+    //bench mode
+    unsigned runs = 5;
+    BenchCache cache = BenchCache::Warm;
+    bool json = false;
+};
+
+static bool parseOptions(int argc, char* argv[], Options& opt)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--index") {
+            if (++i >= argc) return false;
+            opt.indexFile = argv[i];
+        }
+        else if (a == "--jsonl") {
+            if (++i >= argc) return false;
+            opt.jsonlFile = argv[i];
+        }
+        else if (a == "--stats") {
+            if (++i >= argc) return false;
+            if (!parseNumber(argv[i], opt.statsInterval) || !(opt.statsInterval > 0)) return false;
+        }
+        else if (a == "--socket") {
+            if (++i >= argc) return false;
+            opt.socket = argv[i];
+        }
+        else if (a == "--settle-ms") {
+            if (++i >= argc) return false;
+            if (!parseNumber(argv[i], opt.settleMs)) return false;
+        }
+        else if (a == "--checkpoint") {
+            if (++i >= argc) return false;
+            if (!parseNumber(argv[i], opt.checkpointSeconds) || !(opt.checkpointSeconds > 0)) return false;
+        }
+        else if (a == "--under") {
+            if (++i >= argc) return false;
+            opt.scope.under = argv[i];
+        }
+        else if (a == "--name") {
+            if (++i >= argc) return false;
+            opt.scope.name = argv[i];
+        }
+        else if (a == "--resume") {
+            opt.resume = true;
+        }
+        else if (a == "--inode-cache") {
+            if (++i >= argc) return false;
+            opt.inodeCache = argv[i];
+        }
+        else if (a == "--metrics") {
+            if (++i >= argc) return false;
+            opt.metricsFile = argv[i];
+        }
+        else if (a == "--runs") {
+            if (++i >= argc) return false;
+            if (!parseNumber(argv[i], opt.runs)) return false;
+        }
+        else if (a == "--cache") {
+            if (++i >= argc) return false;
+            std::string cache = argv[i];
+            if (cache == "warm") opt.cache = BenchCache::Warm;
+            else if (cache == "cold") opt.cache = BenchCache::Cold;
+            else return false;
+        }
+        else if (a == "--json") {
+            opt.json = true;
+        }
+        else if (a == "--no-index") {
+            opt.writeIndex = false;
+        }
+        else if (a == "--incremental") {
+            opt.incremental = true;
+        }
+        else if (a == "--portable-sha256") {
+            SHA256::usePortable();
+        }
+        else if (a == "--batch-kb") {
+            if (++i >= argc) return false;
+            if (!parseNumber(argv[i], opt.batchKB) || opt.batchKB > UINT64_MAX / 1024) return false;
+        }
+        else if (a == "--mmap-mb") {
+            if (++i >= argc) return false;
+            if (!parseNumber(argv[i], opt.mmapMB) || opt.mmapMB > UINT64_MAX >> 20) return false;
+        }
+        else if (a == "--io") {
+            if (++i >= argc) return false;
+            std::string io = argv[i];
+            if (io == "uring") opt.io = ReadOptions::Engine::Uring;
+            else if (io == "sync") opt.io = ReadOptions::Engine::Sync;
+            else return false;
+        }
+        else if (a == "--scan") {
+            if (++i >= argc) return false;
+            std::string scan = argv[i];
+            if (scan == "parallel") opt.parallelScan = true;
+            else if (scan == "sequential") opt.parallelScan = false;
+            else return false;
+        }
+        else if (a == "--schedule") {
+            if (++i >= argc) return false;
+            std::string sched = argv[i];
+            if (sched == "lpt") opt.schedule = IndexConfig::Schedule::LargestFirst;
+            else if (sched == "fifo") opt.schedule = IndexConfig::Schedule::Fifo;
+            else return false;
+        }
+        else if (a == "--page-cache") {
+            if (++i >= argc) return false;
+            std::string cache = argv[i];
+            if (cache == "keep") opt.pageCache = ReadOptions::Cache::Keep;
+            else if (cache == "drop") opt.pageCache = ReadOptions::Cache::Drop;
+            else if (cache == "direct") opt.pageCache = ReadOptions::Cache::Direct;
+            else return false;
+        }
+        else if (a == "--read-kb") {
+            if (++i >= argc) return false;
+            if (!parseNumber(argv[i], opt.readKB) || opt.readKB == 0 || opt.readKB > UINT64_MAX / 1024) return false;
+        }
+        else if (a == "--shard") {
+            if (++i >= argc) return false;
+            opt.shardSpec = argv[i];
+        }
+        else if (a == "--subtree") {
+            if (++i >= argc) return false;
+            opt.subtrees.push_back(argv[i]);
+        }
+        else if (a == "--pin") {
+            if (++i >= argc) return false;
+            std::string pin = argv[i];
+            if (pin == "none") opt.pin = IndexConfig::Pin::None;
+            else if (pin == "cores") opt.pin = IndexConfig::Pin::Cores;
+            else if (pin == "nodes") opt.pin = IndexConfig::Pin::Nodes;
+            else return false;
+        }
+        else if (a == "--readers") {
+            if (++i >= argc) return false;
+            if (!parseNumber(argv[i], opt.readers) || opt.readers < 1) return false;
+        }
+        else if (a == "--io-depth") {
+            if (++i >= argc) return false;
+            if (!parseNumber(argv[i], opt.ioDepth) || opt.ioDepth < 1) return false;
+        }
+        else if (a == "--hash") {
+            if (++i >= argc || !parseHashAlgo(argv[i], opt.hash.algo)) return false;
+        }
+        else if (a == "--tree-mb") {
+            if (++i >= argc) return false;
+            uint64_t mb;
+            if (!parseNumber(argv[i], mb) || mb > UINT64_MAX >> 20) return false;
+            opt.hash.treeThreshold = mb << 20;
+        }
+        else if (a == "--tree-threads") {
+            if (++i >= argc) return false;
+            if (!parseNumber(argv[i], opt.hash.treeThreads) || opt.hash.treeThreads < 1) return false;
+            opt.treeThreadsGiven = true;
+        }
+        else if (a.rfind("--", 0) == 0) {
+            return false;
+        }
+        else if (opt.mode.empty()) {
+            opt.mode = a;
+        }
+        else {
+            opt.args.push_back(a);
+        }
+    }
+    return !opt.mode.empty();
+}
+
+//number of positional arguments each mode needs
+static size_t requiredArgs(const Options& opt)
+{
+    const std::string& mode = opt.mode;
+    if (mode == "index" || mode == "dupes" || mode == "bench" || mode == "serve" || mode == "merge") return 1;
+    //a scoped checksum with no filenames lists every file in scope
+    if (mode == "du" || (mode == "checksum" && opt.scope.any())) return 1;
+    if (mode == "find" || mode == "checksum") return 2;
+    if (mode == "queue-bench") return 0;
+    return SIZE_MAX;
+}
+
+//reads the numbers among the positional arguments, checked before anything runs;
+//false if one is malformed, or if the worker count after the root is neither "auto"
+//nor at least 1: with no workers a run indexes nothing, and would replace a good
+//index with an empty one
+static bool parsePositional(Options& opt)
+{
+    const bool takesWorkers = opt.mode == "index" || opt.mode == "dupes" || opt.mode == "bench" ||
+                              opt.mode == "serve";
+    if (takesWorkers && opt.args.size() >= 2 && opt.args[1] != "auto") {
+        return parseNumber(opt.args[1], opt.workers) && opt.workers >= 1;
+    }
+    if (opt.mode == "find" && opt.args.size() >= 2) return parseNumber(opt.args[1], opt.minMB);
+    if (opt.mode == "queue-bench" && !opt.args.empty()) return parseNumber(opt.args[0], opt.jobs);
+    return true;
+}
+
+//reads --shard <k>/<n>, where shards are numbered from 0: 0 <= k < n; false,
+//with an error naming the flag, if it is anything else
+static bool parseShard(Options& opt)
+{
+    const std::string_view spec = opt.shardSpec;
+    const size_t slash = spec.find('/');
+    if (slash == std::string_view::npos || !parseNumber(spec.substr(0, slash), opt.shard) ||
+        !parseNumber(spec.substr(slash + 1), opt.shards) || opt.shards == 0 || opt.shard >= opt.shards) {
+        std::cerr << "Invalid --shard " << opt.shardSpec << ": expected <k>/<n> with 0 <= k < n\n";
+        return false;
+    }
+    return true;
+}
+
+//the indexing settings given on the command line; the worker count is the
+//optional argument after the root
+static IndexConfig indexConfig(const Options& opt)
+{
+    IndexConfig cfg;
+    if (opt.workers > 0) {
+        cfg.workers = opt.workers;
+    }
+    else if (!opt.args.empty()) {
+        const WorkerPlan plan = planWorkers(opt.args[0]);
+        cfg.workers = plan.pool;
+        cfg.autoStart = plan.start;
+    }
+    cfg.pin = opt.pin;
+    cfg.shard = opt.shard;
+    cfg.shards = opt.shards;
+    cfg.subtrees = opt.subtrees;
+    cfg.batchLimit = opt.batchKB * 1024;
+    cfg.read.mmapThreshold = opt.mmapMB << 20;
+    cfg.read.engine = opt.io;
+    cfg.read.uringDepth = opt.ioDepth;
+    cfg.read.cache = opt.pageCache;
+    if (opt.readKB > 0) cfg.read.readSize = cfg.read.uringChunk = opt.readKB * 1024;
+    cfg.parallelScan = opt.parallelScan;
+    cfg.schedule = opt.schedule;
+    cfg.readers = opt.readers;
+    cfg.hash = opt.hash;
+    //every worker may be tree hashing at once, so each defaults to its share of the cores
+    if (!opt.treeThreadsGiven) {
+        cfg.hash.treeThreads = std::max(1u, std::thread::hardware_concurrency() / std::max(1, cfg.workers));
+    }
+    return cfg;
+}
+
+//the records a query runs against: the persisted index when it was built for
+//this root, otherwise a fresh in-memory index of the tree
+//without a usable index, the tree is indexed in memory with only what the query
+//needs: `find` and `du` list sizes without reading any file, `checksum` stats and
+//hashes only the files with a requested name, and a query under a directory
+//(`under`, relative to the root) lists only that subtree
+static RecordStore recordsForQuery(const Options& opt, const fs::path& root, const std::string& under = "")
+{
+    RecordStore records;
+    std::string indexedRoot;
+    HashAlgo algo;
+    if (loadIndex(opt.indexFile, indexedRoot, algo, records)) {
+        if (indexedRoot == normalRoot(root)) return records;
+        std::cerr << opt.indexFile.string() << " indexes " << indexedRoot
+                  << ", re-indexing " << root.string() << "\n";
+    }
+    else {
+        std::cerr << "No index at " << opt.indexFile.string()
+                  << ", re-indexing " << root.string() << "\n";
+    }
+    IndexConfig cfg;
+    cfg.read.engine = opt.io;
+    cfg.hash = opt.hash;
+    std::vector<std::string> names;
+    if (opt.mode != "checksum") {
+        cfg.hashContents = false;
+    }
+    else if (opt.args.size() > 1) {
+        names.assign(opt.args.begin() + 1, opt.args.end());
+        std::sort(names.begin(), names.end());
+        cfg.names = &names;
+    }
+    if (!under.empty()) cfg.subtrees = {under};
+    IndexStats stats;
+    return indexDirectory(root, cfg, stats);
+}
+
+//CLI QUERY: find, checksum or du over the files under --under whose names match
+//--name, all answered by range lookups on a columnar index: the index file mapped
+//in place when it indexes `root`, otherwise an in-memory index of just that
+//subtree, encoded the same way
+static bool queryScoped(const Options& opt, const fs::path& root)
+{
+    const std::string normal = normalRoot(root);
+    std::string rel;
+    if (!opt.scope.relative(normal, rel)) {
+        std::cerr << opt.scope.under.string() << " is not under " << root.string() << "\n";
+        return false;
+    }
+    MappedFile map(opt.indexFile);
+    ColumnIndex idx;
+    std::string spelled, built;
+    if (!map.data() || !idx.parse(map.data(), map.size()) || idx.root() != normal ||
+        (idx.size() > 0 && !indexedRootSpelling(idx, spelled))) {
+        std::ostringstream out;
+        if (!ColumnIndex::write(out, normal, opt.hash.algo, recordsForQuery(opt, root, rel))) return false;
+        built = out.str();
+        if (!idx.parse(built.data(), built.size())) return false;
+        if (idx.size() > 0 && !indexedRootSpelling(idx, spelled)) return false;
+    }
+
+    //an empty index has no path to read the spelling from: it is the root as given
+    if (idx.size() == 0) {
+        spelled = root.native();
+        if (!spelled.empty() && spelled.back() == '/') spelled.pop_back();
+    }
+    std::string dir = rel.empty() ? spelled : spelled + "/" + rel;
+    if (dir.empty()) dir = "/";
+    size_t first = 0, last = 0;
+    if (idx.size() > 0 && !idx.prefixRange(dir + (dir == "/" ? "" : "/"), first, last)) return false;
+    //no file lies under it, so a misspelled --under cannot pass for an empty directory
+    if (!rel.empty() && first == last) {
+        std::cerr << dir << ": no such directory in the index\n";
+        return false;
+    }
+    bool ok;
+    if (opt.mode == "du") {
+        ok = duColumns(idx, first, last, dir, opt.scope);
+    }
+    else if (opt.mode == "find") {
+        ok = findColumns(idx, first, last, opt.scope, opt.minMB);
+    }
+    else {
+        ok = checksumColumns(idx, first, last, opt.scope,
+                             std::vector<std::string>(opt.args.begin() + 1, opt.args.end()));
+    }
+    if (!ok) std::cerr << "Failed to read " << (built.empty() ? opt.indexFile.string() : "the index") << "\n";
+    return ok;
+}
+
+//entrypoint
+int main(int argc, char* argv[])
+{
+    Options opt;
+    if (!parseOptions(argc, argv, opt) || opt.args.size() < requiredArgs(opt) || !parsePositional(opt)) {
+        std::cerr <<
+          "Usage:\n"
+          "  index <root> [workers] [--incremental] [--batch-kb <KB>]\n"
+          "        [--mmap-mb <MB>] [--io sync|uring] [--io-depth <n>]\n"
+          "        [--scan parallel|sequential] [--schedule fifo|lpt] [--index <file>]\n"
+          "        [--hash sha256|blake3|xxh3] [--tree-mb <MB>] [--tree-threads <n>]\n"
+          "        [--jsonl <file>|-] [--no-index] [--stats <seconds>] [--metrics <file>]\n"
+          "        [--inode-cache <file>] [--readers <n>] [--page-cache keep|drop|direct]\n"
+          "        [--read-kb <KB>] [--pin none|cores|nodes] [--shard <k>/<n>]\n"
+          "        [--subtree <dir>]... [--checkpoint <seconds>] [--resume]\n"
+          "  merge <shard index>... [--index <file>]\n"
+          "  find <root> <MB> [--index <file>] [--socket <path>] [--under <dir>] [--name <glob>]\n"
+          "  checksum <root> <filename>... [--index <file>] [--socket <path>]\n"
+          "        [--under <dir>] [--name <glob>]\n"
+          "  checksum <root> --under <dir>|--name <glob> [--index <file>]\n"
+          "  du <root> [--under <dir>] [--name <glob>] [--index <file>]\n"
+          "  serve <root> [workers] [--socket <path>] [--settle-ms <ms>] [--index <file>]\n"
+          "        [--no-index] [index options]\n"
+          "  dupes <root> [workers] [--hash sha256|blake3|xxh3]\n"
+          "  bench <root> [workers] [--runs <n>] [--cache warm|cold] [--json]\n"
+          "        [index options]\n"
+          "  queue-bench [jobs]\n"
+          "--shard k/n keeps shard k of n, numbered from 0 (0 <= k < n)\n";
+        return 1;
+    }
+    if (!opt.shardSpec.empty() && !parseShard(opt)) return 1;
+
+    if (opt.mode == "queue-bench") {
+        queueBench(opt.jobs);
+        return 0;
+    }
+
+    if (opt.mode == "merge") {
+        return mergeShards(opt.args, opt.indexFile) ? 0 : 1;
+    }
+
+    fs::path root = opt.args[0];
+
+    if (opt.mode == "dupes") {
+        findDupes(root, indexConfig(opt));
+    }
+    else if (opt.mode == "bench") {
+        bench(root, indexConfig(opt), opt.runs, opt.cache, opt.json);
+    }
+    else if (opt.mode == "index") {
+        IndexConfig cfg = indexConfig(opt);
+
+        //incremental runs need the previous index of the same root, hashed the same way
+        RecordStore previousRecords;
+        PreviousIndex previous;
+        if (opt.incremental) {
+            if (loadPrevious(opt.indexFile, root, cfg.hash.algo, previousRecords, previous)) {
+                cfg.previous = &previous;
+            }
+            else {
+                std::cerr << "No previous " << hashAlgoName(cfg.hash.algo) << " index of "
+                          << root.string() << " at " << opt.indexFile.string()
+                          << ", building a full index\n";
+            }
+        }
+
+        //the journal next to the index; a resumed run reuses the hashes of every
+        //file it lists that is unchanged since, on top of an incremental run's
+        fs::path journal = opt.indexFile;
+        journal += ".ckpt";
+        RecordStore resumedRecords;
+        std::unique_ptr<CheckpointWriter> checkpoint;
+        if (opt.checkpointSeconds > 0 || opt.resume) {
+            uint64_t keep = 0;
+            if (opt.resume) {
+                if (loadCheckpoint(journal, normalRoot(root), cfg.hash.algo, resumedRecords, keep)) {
+                    respellRoot(resumedRecords, normalRoot(root), root);
+                    previous.reserve(previous.size() + resumedRecords.size());
+                    for (const auto& r : resumedRecords) previous[resumedRecords.path(r)] = &r;
+                    cfg.previous = &previous;
+                    std::cerr << "Resuming with " << resumedRecords.size() << " files from "
+                              << journal.string() << "\n";
+                }
+                else {
+                    std::cerr << "No checkpoint of " << root.string() << " at " << journal.string()
+                              << ", starting afresh\n";
+                }
+            }
+            checkpoint = std::make_unique<CheckpointWriter>(
+                journal, normalRoot(root), cfg.hash.algo,
+                opt.checkpointSeconds > 0 ? opt.checkpointSeconds : DEFAULT_CHECKPOINT_SECONDS, keep);
+            if (!checkpoint->ok()) {
+                std::cerr << "Failed to open " << journal.string() << "\n";
+                return 1;
+            }
+            cfg.checkpoint = checkpoint.get();
+        }
+
+        if (!opt.writeIndex && opt.jsonlFile.empty()) {
+            std::cerr << "--no-index needs --jsonl <file>\n";
+            return 1;
+        }
+        std::unique_ptr<JsonlWriter> jsonl;
+        if (!opt.jsonlFile.empty()) {
+            jsonl = std::make_unique<JsonlWriter>(opt.jsonlFile, cfg.hash.algo);
+            if (!jsonl->ok()) {
+                std::cerr << "Failed to open " << opt.jsonlFile.string() << "\n";
+                return 1;
+            }
+            cfg.jsonl = jsonl.get();
+        }
+        cfg.keepRecords = opt.writeIndex;
+
+        std::unique_ptr<RunMetrics> metrics;
+        if (opt.statsInterval > 0 || !opt.metricsFile.empty()) {
+            RunMetrics::Options m;
+            if (opt.statsInterval > 0) m.interval = opt.statsInterval;
+            m.statsLine = opt.statsInterval > 0;
+            m.file = opt.metricsFile;
+            metrics = std::make_unique<RunMetrics>(cfg.workers, m);
+            cfg.metrics = metrics.get();
+        }
+
+        std::unique_ptr<InodeCache> inodes;
+        if (!opt.inodeCache.empty()) {
+            inodes = std::make_unique<InodeCache>(true);
+            inodes->load(opt.inodeCache, cfg.hash.algo);
+            cfg.inodes = inodes.get();
+        }
+
+        IndexStats stats;
+        auto records = indexDirectory(root, cfg, stats);
+        if (inodes && !inodes->save(opt.inodeCache, cfg.hash.algo)) {
+            std::cerr << "Failed to write " << opt.inodeCache.string() << "\n";
+        }
+        if (jsonl && !jsonl->finish()) {
+            std::cerr << "Failed to write " << opt.jsonlFile.string() << "\n";
+            return 1;
+        }
+        if (opt.writeIndex && !saveIndex(opt.indexFile, root, cfg.hash.algo, records)) {
+            std::cerr << "Failed to write index " << opt.indexFile.string() << "\n";
+            return 1;
+        }
+        //the run is complete and written out: nothing is left to resume
+        if (checkpoint) {
+            checkpoint->finish();
+            std::error_code ec;
+            fs::remove(journal, ec);
+        }
+        //with --no-index the workers have dropped most records, but each was counted
+        //there are no progress lines when the JSONL goes to standard output
+        if (opt.jsonlFile == "-") return 0;
+        const uint64_t linked = stats.linked.load();
+        std::cout << "Indexed " << stats.hashed.load() + stats.reused.load() + linked << " files into ";
+        if (opt.writeIndex) std::cout << opt.indexFile.string();
+        if (opt.writeIndex && jsonl) std::cout << " and ";
+        if (jsonl) std::cout << opt.jsonlFile.string();
+        if (cfg.previous || linked > 0) {
+            std::cout << " (" << stats.hashed.load() << " hashed, " << stats.reused.load() << " unchanged";
+            if (linked > 0) std::cout << ", " << linked << " sharing an inode already hashed";
+            std::cout << ")";
+        }
+        std::cout << "\n";
+    }
+#if INDEXER_SERVE
+    else if (opt.mode == "serve") {
+        return serve(root, indexConfig(opt), opt.indexFile, opt.writeIndex,
+                     opt.socket.empty() ? fs::path(DEFAULT_SOCKET) : opt.socket, opt.settleMs);
+    }
+    else if ((opt.mode == "find" || opt.mode == "checksum") && !opt.socket.empty() && !opt.scope.any()) {
+        //the daemon serves one root, so the root argument is not checked
+        const std::vector<std::string> args(opt.args.begin() + 1, opt.args.end());
+        if (!queryServer(opt.socket, opt.mode, args)) {
+            std::cerr << "No server on " << opt.socket.string() << "\n";
+            return 1;
+        }
+    }
+#endif
+    else if (opt.mode == "du" || ((opt.mode == "find" || opt.mode == "checksum") && opt.scope.any())) {
+        //the server is not asked: its index is not kept in path order
+        return queryScoped(opt, root) ? 0 : 1;
+    }
+    else if (opt.mode == "find" || opt.mode == "checksum") {
+        //a JSONL index holds no root, so it is queried whatever root is given
+        const bool jsonl = isJsonlIndex(opt.indexFile);
+        const std::vector<std::string> filenames(opt.args.begin() + 1, opt.args.end());
+        bool ok = true;
+        if (opt.mode == "find") {
+            if (jsonl) ok = queryFindJsonl(opt.indexFile, opt.minMB);
+            else if (!queryFindMapped(opt.indexFile, root, opt.minMB)) {
+                queryFind(recordsForQuery(opt, root), opt.minMB);
+            }
+        }
+        else {
+            if (jsonl) ok = queryChecksumJsonl(opt.indexFile, filenames);
+            else if (!queryChecksumMapped(opt.indexFile, root, filenames)) {
+                queryChecksum(recordsForQuery(opt, root), filenames);
+            }
+        }
+        if (!ok) {
+            std::cerr << "Failed to read " << opt.indexFile.string() << "\n";
+            return 1;
+        }
+    }
+
+    return 0;
+}
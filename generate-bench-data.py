@@ -0,0 +1,159 @@
+"""
+Generate synthetic benchmark trees for the file indexers.
+
+Every tree is reproducible: file names, sizes, contents and modification times
+all come from --seed, so two runs with the same arguments produce identical trees.
+
+Shapes:
+- tiny:  millions of tiny files (0-4 KB), 1000 per directory
+- deep:  files spread along one chain of nested directories
+- wide:  every file in a single directory
+- huge:  a few very large files
+- mixed: small / medium / large files, sized like the categories of generate-test-data.py
+
+"""
+
+from __future__ import annotations
+
+import argparse
+import json
+import os
+import random
+from pathlib import Path
+from typing import Dict, Any, List, Tuple
+
+#all files get modification times counting up from here, never the time of the run
+BASE_MTIME = 1_700_000_000
+
+#bytes generated per write for large files
+BLOCK = 1 << 20
+
+#default file count per shape
+DEFAULT_FILES = {
+    "tiny": 1_000_000,
+    "deep": 10_000,
+    "wide": 100_000,
+    "huge": 4,
+    "mixed": 10_000,
+}
+
+#mixed shape: (category, share of files, min KB, max KB), as in generate-test-data.py
+MIXED_CATEGORIES = [
+    ("small", 0.90, 1, 4),
+    ("medium", 0.09, 100, 500),
+    ("large", 0.01, 10_240, 10_240),
+]
+
+
+def plan_tree(shape: str, files: int, depth: int, huge_mb: int,
+              rng: random.Random) -> List[Tuple[str, int]]:
+    """(relative path, size in bytes) of every file of the tree, in creation order"""
+    plan: List[Tuple[str, int]] = []
+
+    if shape == "tiny":
+        for i in range(files):
+            plan.append((f"d{i // 1000:05d}/f{i:07d}.dat", rng.randint(0, 4096)))
+
+    elif shape == "deep":
+        #the same number of files at every level of the chain
+        per_level = max(1, files // depth)
+        for i in range(files):
+            level = min(i // per_level, depth - 1)
+            parts = [f"l{d:03d}" for d in range(level + 1)]
+            plan.append(("/".join(parts) + f"/f{i:06d}.dat", rng.randint(1024, 16 * 1024)))
+
+    elif shape == "wide":
+        for i in range(files):
+            plan.append((f"f{i:07d}.dat", rng.randint(1024, 16 * 1024)))
+
+    elif shape == "huge":
+        for i in range(files):
+            plan.append((f"huge{i:02d}.bin", huge_mb * 1024 * 1024))
+
+    elif shape == "mixed":
+        for i in range(files):
+            r = rng.random()
+            for category, share, lo, hi in MIXED_CATEGORIES:
+                if r < share or category == MIXED_CATEGORIES[-1][0]:
+                    break
+                r -= share
+            plan.append((f"{category}/d{i // 1000:04d}/f{i:06d}.bin",
+                         rng.randint(lo * 1024, hi * 1024)))
+
+    return plan
+
+
+def write_file(path: Path, size: int, rng: random.Random, mtime: int) -> None:
+    path.parent.mkdir(parents=True, exist_ok=True)
+    with path.open("wb") as f:
+        left = size
+        while left > 0:
+            n = min(left, BLOCK)
+            f.write(rng.randbytes(n))
+            left -= n
+    os.utime(path, (mtime, mtime))
+
+
+def generate(out: Path, shape: str, files: int, depth: int, huge_mb: int,
+             dupes: float, seed: int) -> Dict[str, Any]:
+    rng = random.Random(seed)
+    plan = plan_tree(shape, files, depth, huge_mb, rng)
+
+    #contents come from a stream of their own, so the layout does not depend on them
+    content = random.Random(seed + 1)
+    written: List[Path] = []
+    total = 0
+    for i, (rel, size) in enumerate(plan):
+        path = out / rel
+        #a share of the files repeat an earlier file's contents, for `dupes` runs
+        if written and content.random() < dupes:
+            source = written[content.randrange(len(written))]
+            path.parent.mkdir(parents=True, exist_ok=True)
+            data = source.read_bytes()
+            path.write_bytes(data)
+            os.utime(path, (BASE_MTIME + i, BASE_MTIME + i))
+            size = len(data)
+        else:
+            write_file(path, size, content, BASE_MTIME + i)
+        written.append(path)
+        total += size
+
+    return {
+        "shape": shape,
+        "files": len(plan),
+        "bytes": total,
+        "depth": depth,
+        "huge_mb": huge_mb,
+        "dupes": dupes,
+        "seed": seed,
+    }
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description="Generate a reproducible benchmark tree")
+    parser.add_argument("--shape", choices=sorted(DEFAULT_FILES), required=True)
+    parser.add_argument("--out", type=Path, help="tree root (default: bench_data/<shape>-<seed>)")
+    parser.add_argument("--files", type=int, help="number of files (default depends on the shape)")
+    parser.add_argument("--scale", type=float, default=1.0,
+                        help="multiplies the default number of files, eg: 0.01 for a quick run")
+    parser.add_argument("--depth", type=int, default=64, help="directory levels of the deep shape")
+    parser.add_argument("--huge-mb", type=int, default=1024, help="size of each file of the huge shape")
+    parser.add_argument("--dupes", type=float, default=0.0,
+                        help="share of files that copy an earlier file's contents")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    files = args.files if args.files is not None else max(1, int(DEFAULT_FILES[args.shape] * args.scale))
+    out = args.out or Path("bench_data") / f"{args.shape}-{args.seed}"
+    if out.exists() and any(out.iterdir()):
+        parser.error(f"{out} is not empty")
+
+    manifest = generate(out, args.shape, files, args.depth, args.huge_mb, args.dupes, args.seed)
+    #the manifest sits next to the tree, so it is not indexed with it
+    manifest_file = out.parent / (out.name + ".json")
+    manifest_file.write_text(json.dumps(manifest) + "\n")
+    print(f"{manifest['files']} files, {manifest['bytes']} bytes under {out.resolve()}")
+
+
+if __name__ == "__main__":
+    main()